@@ -49,6 +49,7 @@ void Picoc::LibraryAdd( struct Table *GlobalTable, const char *LibraryName, stru
 		NewValue = Parser.ParseFunctionDefinition( ReturnType, Identifier);
         NewValue->ValFuncDef(pc).Intrinsic = FuncList[Count].Func;
         HeapFreeMem( Tokens);
+        LexTokenCacheClear();
     }
 }
 
@@ -114,6 +115,7 @@ void CLibraryInit()
 void SPutc(unsigned char Ch, union OutputStreamInfo *Stream)
 {
     struct StringOutputStream *Out = &Stream->Str;
+    Out->Parser->VariableCheckRange(Out->WritePos, 1);
     *Out->WritePos++ = Ch;
 }
 
@@ -238,6 +240,7 @@ void GenericPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct
     int FieldWidth = 0;
     char *Format = Param[0]->getVal<PointerType>(pc);
     
+    Parser->VariableCheckString(Format);
     for (FPos = Format; *FPos != '\0'; FPos++)
     {
         if (*FPos == '%')
@@ -304,7 +307,10 @@ void GenericPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct
                                 if (Str == NULL)
                                     PrintStr("NULL", Stream); 
                                 else
+                                {
+                                    Parser->VariableCheckString(Str);
                                     PrintStr(Str, Stream); 
+                                }
                                 break;
                             }
                             case 'd': PrintInt(ExpressionCoerceInteger(NextArg), FieldWidth, ZeroPad, LeftJustify, Stream); break;
@@ -353,6 +359,7 @@ void LibSPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct Val
 /* get a line of input. protected from buffer overrun */
 void LibGets(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), GETS_BUF_MAX);
     ReturnValue->setVal<PointerType>(pc,  PlatformGetLine(Param[0]->getVal<PointerType>(pc), GETS_BUF_MAX, NULL);
     if (ReturnValue->getVal<PointerType>(pc) != NULL)
     {
@@ -467,26 +474,32 @@ void LibFloor(struct ParseState *Parser, struct Value *ReturnValue, struct Value
 #ifndef NO_STRING_FUNCTIONS
 void LibMalloc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->setVal<PointerType>(pc,  malloc(Param[0]->getVal<int>(pc));
+    ReturnValue->setVal<PointerType>(pc,  pc->ScriptMem.ScriptAlloc(Param[0]->getVal<int>(pc)));
 }
 
 #ifndef NO_CALLOC
 void LibCalloc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->setVal<PointerType>(pc,  calloc(Param[0]->getVal<int>(pc), Param[1]->getVal<int>(pc));
+    ReturnValue->setVal<PointerType>(pc,  pc->ScriptMem.ScriptAlloc(Param[0]->getVal<int>(pc) * Param[1]->getVal<int>(pc)));
 }
 #endif
 
 #ifndef NO_REALLOC
 void LibRealloc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->setVal<PointerType>(pc,  realloc(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc));
+    if (!pc->ScriptMem.ScriptIsBlock(Param[0]->getVal<PointerType>(pc)))
+        Parser->ProgramFail( "realloc() of memory malloc() didn't give");
+    
+    ReturnValue->setVal<PointerType>(pc,  pc->ScriptMem.ScriptRealloc(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc)));
 }
 #endif
 
 void LibFree(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    free(Param[0]->getVal<PointerType>(pc));
+    if (!pc->ScriptMem.ScriptIsBlock(Param[0]->getVal<PointerType>(pc)))
+        Parser->ProgramFail( "free() of memory malloc() didn't give");
+    
+    pc->ScriptMem.ScriptFree(Param[0]->getVal<PointerType>(pc));
 }
 
 void LibStrcpy(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -494,6 +507,7 @@ void LibStrcpy(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
     char *To = (char *)Param[0]->getVal<PointerType>(pc);
     char *From = (char *)Param[1]->getVal<PointerType>(pc);
     
+    Parser->VariableCheckRange(To, Parser->VariableCheckString(From) + 1);
     while (*From != '\0')
         *To++ = *From++;
     
@@ -506,6 +520,7 @@ void LibStrncpy(struct ParseState *Parser, struct Value *ReturnValue, struct Val
     char *From = (char *)Param[1]->getVal<PointerType>(pc);
     int Len = Param[2]->getVal<int>(pc);
     
+    Parser->VariableCheckRange(To, Parser->VariableCheckString(From, Len) + 1);
     for (; *From != '\0' && Len > 0; Len--)
         *To++ = *From++;
     
@@ -519,6 +534,8 @@ void LibStrcmp(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
     char *Str2 = (char *)Param[1]->getVal<PointerType>(pc);
     int StrEnded;
     
+    Parser->VariableCheckString(Str1);
+    Parser->VariableCheckString(Str2);
     for (StrEnded = FALSE; !StrEnded; StrEnded = (*Str1 == '\0' || *Str2 == '\0'), Str1++, Str2++)
     {
          if (*Str1 < *Str2) { ReturnValue->setVal<int>(pc, -1); return; } 
@@ -535,6 +552,8 @@ void LibStrncmp(struct ParseState *Parser, struct Value *ReturnValue, struct Val
     int Len = Param[2]->getVal<int>(pc);
     int StrEnded;
     
+    Parser->VariableCheckString(Str1, Len);
+    Parser->VariableCheckString(Str2, Len);
     for (StrEnded = FALSE; !StrEnded && Len > 0; StrEnded = (*Str1 == '\0' || *Str2 == '\0'), Str1++, Str2++, Len--)
     {
          if (*Str1 < *Str2) { ReturnValue->setVal<int>(pc, -1); return; } 
@@ -548,7 +567,9 @@ void LibStrcat(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
 {
     char *To = (char *)Param[0]->getVal<PointerType>(pc);
     char *From = (char *)Param[1]->getVal<PointerType>(pc);
+    size_t ToLen = Parser->VariableCheckString(To);
     
+    Parser->VariableCheckRange(To, ToLen + Parser->VariableCheckString(From) + 1);
     while (*To != '\0')
         To++;
     
@@ -563,6 +584,7 @@ void LibIndex(struct ParseState *Parser, struct Value *ReturnValue, struct Value
     char *Pos = (char *)Param[0]->getVal<PointerType>(pc);
     int SearchChar = Param[1]->getVal<int>(pc);
 
+    Parser->VariableCheckString(Pos);
     while (*Pos != '\0' && *Pos != SearchChar)
         Pos++;
     
@@ -577,6 +599,7 @@ void LibRindex(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
     char *Pos = (char *)Param[0]->getVal<PointerType>(pc);
     int SearchChar = Param[1]->getVal<int>(pc);
 
+    Parser->VariableCheckString(Pos);
     ReturnValue->setVal<PointerType>(pc,  NULL;
     for (; *Pos != '\0'; Pos++)
     {
@@ -590,6 +613,7 @@ void LibStrlen(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
     char *Pos = (char *)Param[0]->getVal<PointerType>(pc);
     int Len;
     
+    Parser->VariableCheckString(Pos);
     for (Len = 0; *Pos != '\0'; Pos++)
         Len++;
     
@@ -599,12 +623,15 @@ void LibStrlen(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
 void LibMemset(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
     /* we can use the system memset() */
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
     memset(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc));
 }
 
 void LibMemcpy(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
     /* we can use the system memcpy() */
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
+    Parser->VariableCheckRange(Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
     memcpy(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
 }
 
@@ -614,6 +641,8 @@ void LibMemcmp(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
     unsigned char *Mem2 = (unsigned char *)Param[1]->getVal<PointerType>(pc);
     int Len = Param[2]->getVal<int>(pc);
     
+    Parser->VariableCheckRange(Mem1, Len);
+    Parser->VariableCheckRange(Mem2, Len);
     for (; Len > 0; Mem1++, Mem2++, Len--)
     {
          if (*Mem1 < *Mem2) { ReturnValue->setVal<int>(pc, -1); return; } 
@@ -100,6 +100,7 @@ void MathFmod(struct ParseState *Parser, struct Value *ReturnValue, struct Value
 void MathFrexp(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[1]->getVal<int*>(pc), sizeof(int));
     ReturnValue->setVal<double>(pc,  frexp(Param[0]->getVal<double>(pc), Param[1]->getVal<int*>(pc)));
 }
 
@@ -124,7 +125,8 @@ void MathLog10(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
 void MathModf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<double>(pc,  modf(Param[0]->getVal<double>(pc), Param[0]->getVal<double*>(pc)));
+    Parser->VariableCheckRange(Param[1]->getVal<double*>(pc), sizeof(double));
+    ReturnValue->setVal<double>(pc,  modf(Param[0]->getVal<double>(pc), Param[1]->getVal<double*>(pc)));
 }
 
 void MathPow(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
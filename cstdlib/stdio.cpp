@@ -2,6 +2,8 @@
 #ifndef BUILTIN_MINI_STDLIB
 
 #include <errno.h>
+#include <ctype.h>
+#include <limits.h>
 #include "../interpreter.h"
 
 #define MAX_FORMAT 80
@@ -42,6 +44,45 @@ struct StdVararg
     int NumArgs;
 };
 
+/* the FILE a program passes us. it has to be one we gave it - anything else would have stdio 
+ * working on memory of the program's making */
+static FILE *StdioStream(struct ParseState *Parser, struct Value *Arg)
+{
+	Picoc *pc = Parser->pc;
+    FILE *Stream = static_cast<FILE*>(Arg->getVal<PointerType>(pc));
+    
+    if (pc->Streams.find(Stream) == pc->Streams.end())
+        Parser->ProgramFail( "not an open FILE");
+    
+    return Stream;
+}
+
+/* the size of Count items of Size bytes, for fread() and fwrite(). a negative one's too big to check */
+static size_t StdioItemsSize(int Size, int Count)
+{
+    if (Size < 0 || Count < 0)
+        return (size_t)-1;
+    
+    return (size_t)Size * (size_t)Count;
+}
+
+/* remember a FILE we've given the program */
+static void *StdioStreamOpened(Picoc *pc, FILE *Stream)
+{
+    if (Stream != NULL)
+        pc->Streams.insert(Stream);
+    
+    return Stream;
+}
+
+/* the va_list a program passes us. nothing a program can do makes one, so it could only be made up, 
+ * and it'd have us reading Values of the program's making */
+static struct StdVararg *StdioVarargs(struct ParseState *Parser, struct Value *Arg)
+{
+    Parser->ProgramFail( "va_list isn't supported");
+    return NULL;
+}
+
 /* initialises the I/O system so error reporting works */
 void Picoc::BasicIOInit()
 {
@@ -98,11 +139,26 @@ void StdioOutPuts(const char *Str, StdOutStream *Stream)
                     Stream->StrOutLen--;
         
                 Stream->CharCount++;
-            }            
+            }
+            else
+                break;
         }
     }
 }
 
+/* move on past what snprintf() put in a string. if it was cut short we're at the end of the string */
+void StdioStrOutAdvance(StdOutStream *Stream, int CCount)
+{
+    int Written = CCount;
+    
+    if (Written > Stream->StrOutLen - 1)
+        Written = Stream->StrOutLen > 0 ? Stream->StrOutLen - 1 : 0;
+    
+    Stream->StrOutPtr += Written;
+    Stream->StrOutLen -= Written;
+    Stream->CharCount += CCount;
+}
+
 /* printf-style format of an int or other word-sized object */
 void StdioFprintfWord(StdOutStream *Stream, const char *Format, unsigned long Value)
 {
@@ -116,9 +172,7 @@ void StdioFprintfWord(StdOutStream *Stream, const char *Format, unsigned long Va
 #else
 		int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen, Format, Value);
 #endif
-		Stream->StrOutPtr += CCount;
-        Stream->StrOutLen -= CCount;
-        Stream->CharCount += CCount;
+        StdioStrOutAdvance(Stream, CCount);
     }
     else
     {
@@ -141,9 +195,7 @@ void StdioFprintfFP(StdOutStream *Stream, const char *Format, double Value)
 #else
         int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen, Format, Value);
 #endif
-		Stream->StrOutPtr += CCount;
-        Stream->StrOutLen -= CCount;
-        Stream->CharCount += CCount;
+        StdioStrOutAdvance(Stream, CCount);
     }
     else
     {
@@ -166,9 +218,7 @@ void StdioFprintfPointer(StdOutStream *Stream, const char *Format, void *Value)
 #else
 		int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen, Format, Value);
 #endif
-        Stream->StrOutPtr += CCount;
-        Stream->StrOutLen -= CCount;
-        Stream->CharCount += CCount;
+        StdioStrOutAdvance(Stream, CCount);
     }
     else
     {
@@ -189,10 +239,24 @@ int StdioBasePrintf(struct ParseState *Parser, FILE *Stream, char *StrOut, int S
     struct ValueType *ShowType;
     StdOutStream SOStream;
     Picoc *pc = Parser->pc; 
+    size_t StrOutRoom = 0;
     
+    Parser->VariableCheckString(Format);
     if (Format == NULL)
         Format = "[null format]\n";
     
+    /* the output can't go past the string, or past the program's memory if we aren't told how long that is */
+    if (StrOut != NULL && StrOutLen < 0)
+    {
+        StrOutRoom = pc->Space.SpaceExtent(StrOut);
+        if (StrOutRoom == 0)
+            Parser->ProgramFail("pointer is outside the program's memory");
+        
+        StrOutLen = StrOutRoom < INT_MAX ? (int)StrOutRoom : INT_MAX;
+    }
+    else if (StrOut != NULL)
+        Parser->VariableCheckRange(StrOut, StrOutLen);
+    
     FPos = Format;    
     SOStream.FilePtr = Stream;
     SOStream.StrOutPtr = StrOut;
@@ -287,10 +351,15 @@ int StdioBasePrintf(struct ParseState *Parser, FILE *Stream, char *StrOut, int S
                     else if (ShowType == pc->CharPtrType)
                     {
                         if (ThisArg->TypeOfValue->Base == TypePointer)
+                        {
+                            Parser->VariableCheckString(ThisArg->getVal<char*>(pc));
                             StdioFprintfPointer(&SOStream, OneFormatBuf, ThisArg->getVal<PointerType>(pc));
-                            
+                        }
                         else if (ThisArg->TypeOfValue->Base == TypeArray && ThisArg->TypeOfValue->FromType->Base == TypeChar)
+                        {
+                            Parser->VariableCheckString((char *)ThisArg->ValAddressOfData(pc));
                             StdioFprintfPointer(&SOStream, OneFormatBuf, ThisArg->ValAddressOfData(pc));
+                        }
                             
                         else
                             StdioOutPuts("XXX", &SOStream);
@@ -323,16 +392,151 @@ int StdioBasePrintf(struct ParseState *Parser, FILE *Stream, char *StrOut, int S
     if (SOStream.StrOutPtr != NULL && SOStream.StrOutLen > 0)
         *SOStream.StrOutPtr = '\0';      
     
+    if (StrOutRoom != 0 && (size_t)SOStream.CharCount >= StrOutRoom)
+        Parser->ProgramFail("pointer is outside the program's memory");
+    
     return SOStream.CharCount;
 }
 
+/* how much one scanf() conversion can write, or 0 if it's one we don't know */
+static size_t StdioScanfSize(char Conversion, const std::string &Length, size_t Width)
+{
+    switch (Conversion)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'n':
+            if (Length == "hh")
+                return sizeof(char);
+            else if (Length == "h")
+                return sizeof(short);
+            else if (Length.empty())
+                return sizeof(int);
+            else
+                return sizeof(long long);
+        
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            if (Length == "l")
+                return sizeof(double);
+            else if (Length == "L")
+                return sizeof(long double);
+            else
+                return sizeof(float);
+        
+        case 'p':   return sizeof(void *);
+        case 'c':   return Width != 0 ? Width : 1;
+        case 's': case '[': return Width + 1;
+    }
+    
+    return 0;
+}
+
+/* check every argument scanf() will write through against what its conversion can write. a %s or %[ 
+ * without a width is given the room its argument has, so the host's scanf() can't run past it. returns 
+ * the format to hand to the host's scanf() */
+static std::string StdioScanfFormat(struct ParseState *Parser, const char *Format, void **ScanfArg, int NumArgs)
+{
+	Picoc *pc = Parser->pc;
+    std::string Checked;
+    const char *FPos = Format;
+    int ArgCount = 0;
+    
+    while (*FPos != '\0')
+    {
+        const char *Start = FPos;
+        std::string Length;
+        size_t Width = 0;
+        bool Suppress = false;
+        char Conversion;
+        
+        if (*FPos != '%')
+        {
+            Checked += *FPos++;
+            continue;
+        }
+        
+        if (FPos[1] == '%')
+        {
+            Checked += "%%";
+            FPos += 2;
+            continue;
+        }
+        
+        FPos++;
+        if (*FPos == '*')
+        {
+            Suppress = true;
+            FPos++;
+        }
+        
+        while (isdigit((unsigned char)*FPos))
+        {
+            if (Width < INT_MAX / 10)
+                Width = Width * 10 + (*FPos - '0');
+            
+            FPos++;
+        }
+        
+        while (*FPos != '\0' && strchr("hlLqjzt", *FPos) != NULL)
+            Length += *FPos++;
+        
+        Conversion = *FPos;
+        if (Conversion == '[')
+        {
+            /* the scan set runs to the next ']', which can be its first character */
+            FPos++;
+            if (*FPos == '^')
+                FPos++;
+            if (*FPos == ']')
+                FPos++;
+            while (*FPos != '\0' && *FPos != ']')
+                FPos++;
+        }
+        
+        if (*FPos != '\0')
+            FPos++;
+        
+        if (Suppress || Conversion == '\0')
+        {
+            Checked.append(Start, FPos);
+            continue;
+        }
+        
+        if (ArgCount >= NumArgs)
+            Parser->ProgramFail( "not enough arguments to scanf()");
+        
+        if (ScanfArg[ArgCount] == NULL)
+            Parser->ProgramFail( "NULL pointer dereference");
+        
+        if ((Conversion == 's' || Conversion == '[') && Width == 0)
+        {
+            size_t Room = pc->Space.SpaceExtent(ScanfArg[ArgCount]);
+            
+            if (Room < 2)
+                Parser->ProgramFail("pointer is outside the program's memory");
+            
+            Checked += '%';
+            Checked += std::to_string(Room - 1 < INT_MAX ? Room - 1 : INT_MAX);
+            Checked.append(Start + 1, FPos);
+        }
+        else
+        {
+            Parser->VariableCheckRange(ScanfArg[ArgCount], StdioScanfSize(Conversion, Length, Width));
+            Checked.append(Start, FPos);
+        }
+        
+        ArgCount++;
+    }
+    
+    return Checked;
+}
+
 /* internal do-anything v[s][n]scanf() formatting system with input from strings or FILE * */
 int StdioBaseScanf(struct ParseState *Parser, FILE *Stream, char *StrIn, char *Format, struct StdVararg *Args)
 {
 	Picoc *pc = Parser->pc;
     struct Value *ThisArg = Args->Param[0];
     int ArgCount = 0;
-    void *ScanfArg[MAX_SCANF_ARGS];
+    void *ScanfArg[MAX_SCANF_ARGS] = { NULL };
+    std::string Checked;
     
     if (Args->NumArgs > MAX_SCANF_ARGS)
         Parser->ProgramFail( "too many arguments to scanf() - %d max", MAX_SCANF_ARGS);
@@ -351,163 +555,187 @@ int StdioBaseScanf(struct ParseState *Parser, FILE *Stream, char *StrIn, char *F
             Parser->ProgramFail( "non-pointer argument to scanf() - argument %d after format", ArgCount+1);
     }
     
+    Parser->VariableCheckString(Format);
+    Parser->VariableCheckString(StrIn);
+    Checked = StdioScanfFormat(Parser, Format, ScanfArg, Args->NumArgs);
+    
     if (Stream != NULL)
-        return fscanf(Stream, Format, ScanfArg[0], ScanfArg[1], ScanfArg[2], ScanfArg[3], ScanfArg[4], ScanfArg[5], ScanfArg[6], ScanfArg[7], ScanfArg[8], ScanfArg[9]);
+        return fscanf(Stream, Checked.c_str(), ScanfArg[0], ScanfArg[1], ScanfArg[2], ScanfArg[3], ScanfArg[4], ScanfArg[5], ScanfArg[6], ScanfArg[7], ScanfArg[8], ScanfArg[9]);
     else
-        return sscanf(StrIn, Format, ScanfArg[0], ScanfArg[1], ScanfArg[2], ScanfArg[3], ScanfArg[4], ScanfArg[5], ScanfArg[6], ScanfArg[7], ScanfArg[8], ScanfArg[9]);
+        return sscanf(StrIn, Checked.c_str(), ScanfArg[0], ScanfArg[1], ScanfArg[2], ScanfArg[3], ScanfArg[4], ScanfArg[5], ScanfArg[6], ScanfArg[7], ScanfArg[8], ScanfArg[9]);
 }
 
 /* stdio calls */
 void StdioFopen(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  fopen(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc)));
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
+    ReturnValue->setVal<PointerType>(pc,  StdioStreamOpened(pc, fopen(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc))));
 }
 
 void StdioFreopen(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  freopen(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc), 
-		static_cast<FILE*>(Param[2]->getVal<PointerType>(pc))));
+    FILE *Stream = StdioStream(Parser, Param[2]);
+    
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
+    pc->Streams.erase(Stream);
+	ReturnValue->setVal<PointerType>(pc,  StdioStreamOpened(pc, freopen(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc), Stream)));
 }
 
 void StdioFclose(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fclose(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc))));
+    FILE *Stream = StdioStream(Parser, Param[0]);
+    
+    pc->Streams.erase(Stream);
+	ReturnValue->setVal<int>(pc, fclose(Stream));
 }
 
 void StdioFread(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), StdioItemsSize(Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc)));
 	ReturnValue->setVal<int>(pc, fread(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc), 
-		static_cast<FILE*>(Param[3]->getVal<PointerType>(pc))));
+		StdioStream(Parser, Param[3])));
 }
 
 void StdioFwrite(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), StdioItemsSize(Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc)));
     ReturnValue->setVal<int>(pc, fwrite(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc), 
-		static_cast<FILE*>(Param[3]->getVal<PointerType>(pc))));
+		StdioStream(Parser, Param[3])));
 }
 
 void StdioFgetc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fgetc(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, fgetc(StdioStream(Parser, Param[0])));
 }
 
 void StdioFgets(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<char*>(pc), Param[1]->getVal<int>(pc));
 	ReturnValue->setVal<PointerType>(pc,  fgets(Param[0]->getVal<char*>(pc), Param[1]->getVal<int>(pc),
-		static_cast<FILE*>(Param[2]->getVal<PointerType>(pc))));
+		StdioStream(Parser, Param[2])));
 }
 
 void StdioRemove(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
 	ReturnValue->setVal<int>(pc, remove(Param[0]->getVal<char*>(pc)));
 }
 
 void StdioRename(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
 	ReturnValue->setVal<int>(pc, rename(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc)));
 }
 
 void StdioRewind(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	rewind(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)));
+	rewind(StdioStream(Parser, Param[0]));
 }
 
 void StdioTmpfile(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  tmpfile());
+    ReturnValue->setVal<PointerType>(pc,  StdioStreamOpened(pc, tmpfile()));
 }
 
 void StdioClearerr(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-    clearerr((FILE *)Param[0]->getVal<PointerType>(pc));
+    clearerr(StdioStream(Parser, Param[0]));
 }
 
 void StdioFeof(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<int>(pc, feof((FILE *)Param[0]->getVal<PointerType>(pc)));
+    ReturnValue->setVal<int>(pc, feof(StdioStream(Parser, Param[0])));
 }
 
 void StdioFerror(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<int>(pc, ferror((FILE *)Param[0]->getVal<PointerType>(pc)));
+    ReturnValue->setVal<int>(pc, ferror(StdioStream(Parser, Param[0])));
 }
 
 void StdioFileno(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
 #ifndef WIN32
-    ReturnValue->setVal<int>(pc, fileno(Param[0]->getVal<PointerType>(pc)));
+    ReturnValue->setVal<int>(pc, fileno(StdioStream(Parser, Param[0])));
 #else
-	ReturnValue->setVal<int>(pc, _fileno(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, _fileno(StdioStream(Parser, Param[0])));
 #endif
 }
 
 void StdioFflush(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fflush(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc))));
+    /* fflush(NULL) flushes everything */
+	ReturnValue->setVal<int>(pc, fflush(Param[0]->getVal<PointerType>(pc) == NULL ? NULL : StdioStream(Parser, Param[0])));
 }
 
 void StdioFgetpos(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fgetpos(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), static_cast<fpos_t*>(Param[1]->getVal<PointerType>(pc))));
+    Parser->VariableCheckRange(Param[1]->getVal<PointerType>(pc), sizeof(fpos_t));
+	ReturnValue->setVal<int>(pc, fgetpos(StdioStream(Parser, Param[0]), static_cast<fpos_t*>(Param[1]->getVal<PointerType>(pc))));
 }
 
 void StdioFsetpos(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fsetpos(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), static_cast<fpos_t*>(Param[1]->getVal<PointerType>(pc))));
+    Parser->VariableCheckRange(Param[1]->getVal<PointerType>(pc), sizeof(fpos_t));
+	ReturnValue->setVal<int>(pc, fsetpos(StdioStream(Parser, Param[0]), static_cast<fpos_t*>(Param[1]->getVal<PointerType>(pc))));
 }
 
 void StdioFputc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fputc(Param[0]->getVal<int>(pc), static_cast<FILE*>(Param[1]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, fputc(Param[0]->getVal<int>(pc), StdioStream(Parser, Param[1])));
 }
 
 void StdioFputs(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fputs(Param[0]->getVal<char*>(pc), static_cast<FILE*>(Param[1]->getVal<PointerType>(pc))));
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+	ReturnValue->setVal<int>(pc, fputs(Param[0]->getVal<char*>(pc), StdioStream(Parser, Param[1])));
 }
 
 void StdioFtell(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, ftell(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, ftell(StdioStream(Parser, Param[0])));
 }
 
 void StdioFseek(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, fseek(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc)));
+	ReturnValue->setVal<int>(pc, fseek(StdioStream(Parser, Param[0]), Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc)));
 }
 
 void StdioPerror(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
     perror(Param[0]->getVal<char*>(pc));
 }
 
 void StdioPutc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, putc(Param[0]->getVal<int>(pc), static_cast<FILE*>(Param[1]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, putc(Param[0]->getVal<int>(pc), StdioStream(Parser, Param[1])));
 }
 
 void StdioPutchar(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
@@ -519,30 +747,34 @@ void StdioPutchar(struct ParseState *Parser, struct Value *ReturnValue, struct V
 void StdioSetbuf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	setbuf(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), Param[1]->getVal<char*>(pc));
+    /* the stream would keep using the program's buffer after it's been freed, so stdio has its own */
+	setvbuf(StdioStream(Parser, Param[0]), NULL, Param[1]->getVal<char*>(pc) != NULL ? _IOFBF : _IONBF, BUFSIZ);
 }
 
 void StdioSetvbuf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	setvbuf(static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), Param[1]->getVal<char*>(pc), Param[2]->getVal<int>(pc), Param[3]->getVal<int>(pc));
+    /* the stream would keep using the program's buffer after it's been freed, so stdio has its own */
+	setvbuf(StdioStream(Parser, Param[0]), NULL, Param[2]->getVal<int>(pc), Param[3]->getVal<int>(pc));
 }
 
 void StdioUngetc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, ungetc(Param[0]->getVal<int>(pc), static_cast<FILE*>(Param[1]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, ungetc(Param[0]->getVal<int>(pc), StdioStream(Parser, Param[1])));
 }
 
 void StdioPuts(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
     ReturnValue->setVal<int>(pc, puts(Param[0]->getVal<char*>(pc)));
 }
 
 void StdioGets(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<char*>(pc), GETS_MAXValue);
     ReturnValue->setVal<PointerType>(pc,  fgets(Param[0]->getVal<char*>(pc), GETS_MAXValue, stdin));
     if (ReturnValue->getVal<PointerType>(pc) != NULL)
     {
@@ -572,7 +804,7 @@ void StdioVprintf(struct ParseState *Parser, struct Value *ReturnValue, struct V
 {
 	Picoc *pc = Parser->pc;
     ReturnValue->setVal<int>(pc, StdioBasePrintf(Parser, stdout, NULL, 0, Param[0]->getVal<char*>(pc), 
-		static_cast<StdVararg*>(Param[1]->getVal<PointerType>(pc))));
+		StdioVarargs(Parser, Param[1])));
 }
 
 void StdioFprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -582,15 +814,15 @@ void StdioFprintf(struct ParseState *Parser, struct Value *ReturnValue, struct V
     
     PrintfArgs.Param = Param + 1;
     PrintfArgs.NumArgs = NumArgs-2;
-	ReturnValue->setVal<int>(pc, StdioBasePrintf(Parser, static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), nullptr, 0, 
+	ReturnValue->setVal<int>(pc, StdioBasePrintf(Parser, StdioStream(Parser, Param[0]), nullptr, 0, 
 		Param[1]->getVal<char*>(pc), &PrintfArgs));
 }
 
 void StdioVfprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, StdioBasePrintf(Parser, static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), nullptr, 0, 
-		Param[1]->getVal<char*>(pc), static_cast<StdVararg*>(Param[2]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, StdioBasePrintf(Parser, StdioStream(Parser, Param[0]), nullptr, 0, 
+		Param[1]->getVal<char*>(pc), StdioVarargs(Parser, Param[2])));
 }
 
 void StdioSprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
@@ -632,7 +864,7 @@ void StdioFscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Va
     
     ScanfArgs.Param = Param+1;
     ScanfArgs.NumArgs = NumArgs-2;
-	ReturnValue->setVal<int>(pc, StdioBaseScanf(Parser, static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), 
+	ReturnValue->setVal<int>(pc, StdioBaseScanf(Parser, StdioStream(Parser, Param[0]), 
 		nullptr, Param[1]->getVal<char*>(pc), &ScanfArgs));
 }
 
@@ -651,35 +883,35 @@ void StdioVsprintf(struct ParseState *Parser, struct Value *ReturnValue, struct
 {
 	Picoc *pc = Parser->pc;
     ReturnValue->setVal<int>(pc, StdioBasePrintf(Parser, nullptr, Param[0]->getVal<char*>(pc), -1, Param[1]->getVal<char*>(pc), 
-		static_cast<StdVararg*>(Param[2]->getVal<PointerType>(pc))));
+		StdioVarargs(Parser, Param[2])));
 }
 
 void StdioVsnprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
     ReturnValue->setVal<int>(pc, StdioBasePrintf(Parser, nullptr, Param[0]->getVal<char*>(pc), Param[1]->getVal<int>(pc), 
-		Param[2]->getVal<char*>(pc), static_cast<StdVararg*>(Param[3]->getVal<PointerType>(pc))));
+		Param[2]->getVal<char*>(pc), StdioVarargs(Parser, Param[3])));
 }
 
 void StdioVscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
 	ReturnValue->setVal<int>(pc, StdioBaseScanf(Parser, stdin, nullptr, Param[0]->getVal<char*>(pc), 
-		static_cast<StdVararg*>(Param[1]->getVal<PointerType>(pc))));
+		StdioVarargs(Parser, Param[1])));
 }
 
 void StdioVfscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, StdioBaseScanf(Parser, static_cast<FILE*>(Param[0]->getVal<PointerType>(pc)), nullptr, 
-		Param[1]->getVal<char*>(pc), static_cast<StdVararg*>(Param[2]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, StdioBaseScanf(Parser, StdioStream(Parser, Param[0]), nullptr, 
+		Param[1]->getVal<char*>(pc), StdioVarargs(Parser, Param[2])));
 }
 
 void StdioVsscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
     ReturnValue->setVal<int>(pc, StdioBaseScanf(Parser, nullptr, Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc), 
-		static_cast<StdVararg*>(Param[2]->getVal<PointerType>(pc))));
+		StdioVarargs(Parser, Param[2])));
 }
 
 /* handy structure definitions */
@@ -775,6 +1007,9 @@ void StdioSetupFunc(Picoc *pc)
 	 pc->VariableDefinePlatformVarFromPointer( "stdin", FilePtrType, (UnionAnyValuePointer )&stdinValue, FALSE,0);
 	 pc->VariableDefinePlatformVarFromPointer( "stdout", FilePtrType, (UnionAnyValuePointer )&stdoutValue, FALSE,0);
 	 pc->VariableDefinePlatformVarFromPointer( "stderr", FilePtrType, (UnionAnyValuePointer )&stderrValue, FALSE,0);
+	 StdioStreamOpened(pc, stdinValue);
+	 StdioStreamOpened(pc, stdoutValue);
+	 StdioStreamOpened(pc, stderrValue);
 
 	/* define NULL, TRUE and FALSE */
 	if (!pc->VariableDefined( pc->TableStrRegister( "NULL")))
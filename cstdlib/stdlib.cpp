@@ -5,10 +5,20 @@
 
 static int Stdlib_ZeroValue = 0;
 
+/* check the string and end pointer strtod() and strtol() are given */
+static void StdlibCheckStrto(struct ParseState *Parser, struct Value **Param)
+{
+	Picoc *pc = Parser->pc;
+    
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckRange(Param[1]->getVal<char**>(pc), sizeof(char *));
+}
+
 #ifndef NO_FP
 void StdlibAtof(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
 	ReturnValue->setVal<double>(pc,  atof(Param[0]->getVal<char*>(pc)));
 }
 #endif
@@ -16,12 +26,14 @@ void StdlibAtof(struct ParseState *Parser, struct Value *ReturnValue, struct Val
 void StdlibAtoi(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
 	ReturnValue->setVal<int>(pc, atoi(Param[0]->getVal<char*>(pc)));
 }
 
 void StdlibAtol(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
 	ReturnValue->setVal<int>(pc, atol(Param[0]->getVal<char*>(pc)));
 }
 
@@ -29,6 +41,7 @@ void StdlibAtol(struct ParseState *Parser, struct Value *ReturnValue, struct Val
 void StdlibStrtod(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    StdlibCheckStrto(Parser, Param);
 	ReturnValue->setVal<double>(pc,  strtod(Param[0]->getVal<char*>(pc), Param[1]->getVal<char**>(pc)));
 }
 #endif
@@ -36,37 +49,94 @@ void StdlibStrtod(struct ParseState *Parser, struct Value *ReturnValue, struct V
 void StdlibStrtol(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    StdlibCheckStrto(Parser, Param);
     ReturnValue->setVal<int>(pc, strtol(Param[0]->getVal<char*>(pc), Param[1]->getVal<char**>(pc), Param[2]->getVal<int>(pc)));
 }
 
 void StdlibStrtoul(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    StdlibCheckStrto(Parser, Param);
     ReturnValue->setVal<int>(pc, strtoul(Param[0]->getVal<char*>(pc), Param[1]->getVal<char**>(pc), Param[2]->getVal<int>(pc)));
 }
 
+/* a script's allocation size. negative sizes can never be satisfied */
+static size_t StdlibSize(int Size)
+{
+    return Size < 0 ? (size_t)-1 : (size_t)Size;
+}
+
+/* fail the program if it hands back memory that malloc() didn't give it */
+static void StdlibBlockCheck(struct ParseState *Parser, void *Mem, const char *FuncName)
+{
+	Picoc *pc = Parser->pc;
+    
+    if (!pc->ScriptMem.ScriptIsBlock(Mem))
+        Parser->ProgramFail( "%s() of memory malloc() didn't give", FuncName);
+}
+
+/* fail the program if resizing OldMem to NewSize would take the script heap over its quota */
+static void StdlibQuotaCheck(struct ParseState *Parser, void *OldMem, size_t NewSize)
+{
+	Picoc *pc = Parser->pc;
+    size_t Quota = pc->Quota.ScriptHeapBytes;
+    
+    if (Quota != 0 && NewSize != (size_t)-1 && pc->ScriptMem.BytesInUse() - pc->ScriptMem.ScriptSize(OldMem) + NewSize > Quota)
+        Parser->ProgramFail( "script heap quota of %d bytes exceeded", (int)Quota);
+}
+
 void StdlibMalloc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  malloc(Param[0]->getVal<int>(pc)));
+    size_t Size = StdlibSize(Param[0]->getVal<int>(pc));
+    
+    StdlibQuotaCheck(Parser, NULL, Size);
+    ReturnValue->setVal<PointerType>(pc,  pc->ScriptMem.ScriptAlloc(Size));
 }
 
 void StdlibCalloc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  calloc(Param[0]->getVal<int>(pc), Param[1]->getVal<int>(pc)));
+    size_t Num = StdlibSize(Param[0]->getVal<int>(pc));
+    size_t Size = StdlibSize(Param[1]->getVal<int>(pc));
+    
+    if (Size != 0 && Num > (size_t)-1 / Size)
+        ReturnValue->setVal<PointerType>(pc,  NULL);
+    else
+    {
+        /* script heap blocks are always cleared */
+        StdlibQuotaCheck(Parser, NULL, Num * Size);
+        ReturnValue->setVal<PointerType>(pc,  pc->ScriptMem.ScriptAlloc(Num * Size));
+    }
 }
 
 void StdlibRealloc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  realloc(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc)));
+    void *Mem = Param[0]->getVal<PointerType>(pc);
+    
+    StdlibBlockCheck(Parser, Mem, "realloc");
+    if (Mem != NULL && Param[1]->getVal<int>(pc) == 0)
+    {
+        pc->ScriptMem.ScriptFree(Mem);
+        ReturnValue->setVal<PointerType>(pc,  NULL);
+    }
+    else
+    {
+        size_t Size = StdlibSize(Param[1]->getVal<int>(pc));
+        
+        StdlibQuotaCheck(Parser, Mem, Size);
+        ReturnValue->setVal<PointerType>(pc,  pc->ScriptMem.ScriptRealloc(Mem, Size));
+    }
 }
 
 void StdlibFree(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    free(Param[0]->getVal<PointerType>(pc));
+    void *Mem = Param[0]->getVal<PointerType>(pc);
+    
+    StdlibBlockCheck(Parser, Mem, "free");
+    pc->ScriptMem.ScriptFree(Mem);
 }
 
 void StdlibRand(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -96,12 +166,19 @@ void StdlibExit(struct ParseState *Parser, struct Value *ReturnValue, struct Val
 void StdlibGetenv(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  getenv(Param[0]->getVal<char*>(pc)));
+    const char *Value;
+    
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Value = getenv(Param[0]->getVal<char*>(pc));
+    
+    /* the environment is the host's, so hand back a copy the program can read */
+    ReturnValue->setVal<PointerType>(pc,  Value == NULL ? NULL : (void *)pc->TableStrRegister(Value));
 }
 
 void StdlibSystem(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
     ReturnValue->setVal<int>(pc, system(Param[0]->getVal<char*>(pc)));
 }
 
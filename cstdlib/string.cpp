@@ -8,40 +8,69 @@ static int String_ZeroValue = 0;
 void StringStrcpy(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  strcpy(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), static_cast<char*>(Param[1]->getVal<PointerType>(pc))));
+    char *To = static_cast<char*>(Param[0]->getVal<PointerType>(pc));
+    char *From = static_cast<char*>(Param[1]->getVal<PointerType>(pc));
+    
+    Parser->VariableCheckRange(To, Parser->VariableCheckString(From) + 1);
+	ReturnValue->setVal<PointerType>(pc,  strcpy(To, From));
 }
 
 void StringStrncpy(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  strncpy(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), 
-		static_cast<char*>(Param[1]->getVal<PointerType>(pc)), Param[2]->getVal<int>(pc)));
+    char *To = static_cast<char*>(Param[0]->getVal<PointerType>(pc));
+    char *From = static_cast<char*>(Param[1]->getVal<PointerType>(pc));
+    size_t Len = Param[2]->getVal<int>(pc);
+    
+    Parser->VariableCheckString(From, Len);
+    Parser->VariableCheckRange(To, Len);
+	ReturnValue->setVal<PointerType>(pc,  strncpy(To, From, Len));
 }
 
 void StringStrcmp(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, strcmp(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), static_cast<char*>(Param[1]->getVal<PointerType>(pc))));
+    char *Str1 = static_cast<char*>(Param[0]->getVal<PointerType>(pc));
+    char *Str2 = static_cast<char*>(Param[1]->getVal<PointerType>(pc));
+    
+    Parser->VariableCheckString(Str1);
+    Parser->VariableCheckString(Str2);
+	ReturnValue->setVal<int>(pc, strcmp(Str1, Str2));
 }
 
 void StringStrncmp(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, strncmp(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), 
-		static_cast<char*>(Param[1]->getVal<PointerType>(pc)), Param[2]->getVal<int>(pc)));
+    char *Str1 = static_cast<char*>(Param[0]->getVal<PointerType>(pc));
+    char *Str2 = static_cast<char*>(Param[1]->getVal<PointerType>(pc));
+    size_t Len = Param[2]->getVal<int>(pc);
+    
+    Parser->VariableCheckString(Str1, Len);
+    Parser->VariableCheckString(Str2, Len);
+	ReturnValue->setVal<int>(pc, strncmp(Str1, Str2, Len));
 }
 
 void StringStrcat(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  strcat(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), static_cast<char*>(Param[1]->getVal<PointerType>(pc))));
+    char *To = static_cast<char*>(Param[0]->getVal<PointerType>(pc));
+    char *From = static_cast<char*>(Param[1]->getVal<PointerType>(pc));
+    size_t ToLen = Parser->VariableCheckString(To);
+    
+    Parser->VariableCheckRange(To, ToLen + Parser->VariableCheckString(From) + 1);
+	ReturnValue->setVal<PointerType>(pc,  strcat(To, From));
 }
 
 void StringStrncat(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  strncat(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), static_cast<char*>(Param[1]->getVal<PointerType>(pc)),
-		Param[2]->getVal<int>(pc)));
+    char *To = static_cast<char*>(Param[0]->getVal<PointerType>(pc));
+    char *From = static_cast<char*>(Param[1]->getVal<PointerType>(pc));
+    size_t Len = Param[2]->getVal<int>(pc);
+    size_t ToLen = Parser->VariableCheckString(To);
+    
+    Parser->VariableCheckRange(To, ToLen + Parser->VariableCheckString(From, Len) + 1);
+	ReturnValue->setVal<PointerType>(pc,  strncat(To, From, Len));
 }
 
 #ifndef WIN32_2
@@ -50,6 +79,7 @@ void StringIndex(struct ParseState *Parser, struct Value *ReturnValue, struct Va
 char *Pos = (char *)Param[0]->getVal<PointerType>(pc);
 int SearchChar = Param[1]->getVal<int>(pc);
 
+Parser->VariableCheckString(Pos);
 while (*Pos != '\0' && *Pos != SearchChar)
 Pos++;
 
@@ -66,6 +96,7 @@ void StringRindex(struct ParseState *Parser, struct Value *ReturnValue, struct V
 char *Pos = (char *)Param[0]->getVal<PointerType>(pc);
 int SearchChar = Param[1]->getVal<int>(pc);
 
+Parser->VariableCheckString(Pos);
 ReturnValue->setVal<PointerType>(pc,  nullptr);
 for (; *Pos != '\0'; Pos++)
 {
@@ -80,109 +111,174 @@ for (; *Pos != '\0'; Pos++)
 void StringStrlen(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, strlen(static_cast<char*>(Param[0]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, Parser->VariableCheckString(static_cast<char*>(Param[0]->getVal<PointerType>(pc))));
 }
 
 void StringMemset(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
     ReturnValue->setVal<PointerType>(pc,  memset(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc)));
 }
 
 void StringMemcpy(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
+    Parser->VariableCheckRange(Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
     ReturnValue->setVal<PointerType>(pc,  memcpy(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc)));
 }
 
 void StringMemcmp(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
+    Parser->VariableCheckRange(Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
     ReturnValue->setVal<int>(pc, memcmp(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc)));
 }
 
 void StringMemmove(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
+    Parser->VariableCheckRange(Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
     ReturnValue->setVal<PointerType>(pc,  memmove(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc)));
 }
 
 void StringMemchr(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[2]->getVal<int>(pc));
     ReturnValue->setVal<PointerType>(pc,  memchr(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc), Param[2]->getVal<int>(pc)));
 }
 
 void StringStrchr(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(static_cast<char*>(Param[0]->getVal<PointerType>(pc)));
 	ReturnValue->setVal<PointerType>(pc,  strchr(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), Param[1]->getVal<int>(pc)));
 }
 
 void StringStrrchr(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(static_cast<char*>(Param[0]->getVal<PointerType>(pc)));
 	ReturnValue->setVal<PointerType>(pc,  strrchr(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), Param[1]->getVal<int>(pc)));
 }
 
 void StringStrcoll(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(static_cast<char*>(Param[0]->getVal<PointerType>(pc)));
+    Parser->VariableCheckString(static_cast<char*>(Param[1]->getVal<PointerType>(pc)));
 	ReturnValue->setVal<int>(pc, strcoll(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), static_cast<char*>(Param[1]->getVal<PointerType>(pc))));
 }
 
 void StringStrerror(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  strerror(Param[0]->getVal<int>(pc)));
+    /* the message is the host's, so hand back a copy the program can read */
+    ReturnValue->setVal<PointerType>(pc,  (void *)pc->TableStrRegister(strerror(Param[0]->getVal<int>(pc))));
 }
 
 void StringStrspn(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
 	ReturnValue->setVal<int>(pc, strspn(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc)));
 }
 
 void StringStrcspn(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
 	ReturnValue->setVal<int>(pc, strcspn(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc)));
 }
 
 void StringStrpbrk(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
     ReturnValue->setVal<PointerType>(pc,  strpbrk(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc)));
 }
 
 void StringStrstr(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
     ReturnValue->setVal<PointerType>(pc,  strstr(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc)));
 }
 
+/* the host's strtok() would keep its place in a string the program might free before the next call, 
+ * so we keep it ourselves and check it again each time */
 void StringStrtok(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  strtok(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc)));
+    char *Str = Param[0]->getVal<char*>(pc);
+    char *Delim = Param[1]->getVal<char*>(pc);
+    char *Token;
+    
+    if (Str == NULL)
+        Str = pc->StrtokNext;
+    
+    Parser->VariableCheckString(Str);
+    Parser->VariableCheckString(Delim);
+    if (Str == NULL)
+    {
+        ReturnValue->setVal<PointerType>(pc,  NULL);
+        return;
+    }
+    
+    Token = Str + strspn(Str, Delim);
+    Str = Token + strcspn(Token, Delim);
+    if (*Str != '\0')
+        *Str++ = '\0';
+    
+    pc->StrtokNext = Str;
+    ReturnValue->setVal<PointerType>(pc,  *Token != '\0' ? Token : NULL);
 }
 
 void StringStrxfrm(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<char*>(pc), Param[2]->getVal<int>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
     ReturnValue->setVal<int>(pc, strxfrm(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc), Param[2]->getVal<int>(pc)));
 }
 
 #ifndef WIN32
+/* the copy goes on the script heap, where the program can reach it and free() it */
 void StringStrdup(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  strdup(Param[0]->getVal<PointerType>(pc));
+    char *Str = Param[0]->getVal<char*>(pc);
+    size_t Len = Parser->VariableCheckString(Str);
+    size_t Quota = pc->Quota.ScriptHeapBytes;
+    char *Copy;
+    
+    if (Quota != 0 && pc->ScriptMem.BytesInUse() + Len + 1 > Quota)
+        Parser->ProgramFail( "script heap quota of %d bytes exceeded", (int)Quota);
+    
+    Copy = Str == NULL ? NULL : (char *)pc->ScriptMem.ScriptAlloc(Len + 1);
+    if (Copy != NULL)
+        memcpy(Copy, Str, Len + 1);
+    
+    ReturnValue->setVal<PointerType>(pc,  Copy);
 }
 
 void StringStrtok_r(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-    ReturnValue->setVal<PointerType>(pc,  strtok_r(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<PointerType>(pc), Param[2]->getVal<PointerType>(pc));
+    char *Str = Param[0]->getVal<char*>(pc);
+    char **SavePtr = Param[2]->getVal<char**>(pc);
+    
+    Parser->VariableCheckRange(SavePtr, sizeof(char *));
+    Parser->VariableCheckString(Str != NULL ? Str : (SavePtr != NULL ? *SavePtr : NULL));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
+    ReturnValue->setVal<PointerType>(pc,  strtok_r(Str, Param[1]->getVal<char*>(pc), SavePtr));
 }
 #endif
 
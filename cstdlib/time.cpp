@@ -6,6 +6,54 @@
 
 static int CLOCKS_PER_SECValue = CLOCKS_PER_SEC;
 
+/* copy a host struct tm into the one buffer the program can reach */
+static void *StdTimeResult(Picoc *pc, struct tm *Result)
+{
+    if (Result == NULL)
+        return NULL;
+    
+    if (pc->TimeBuffer == NULL)
+        pc->TimeBuffer = pc->HeapAllocVirtualMem(sizeof(struct tm));
+    
+    if (pc->TimeBuffer == NULL)
+        return NULL;
+    
+    memcpy(pc->TimeBuffer, Result, sizeof(struct tm));
+    return pc->TimeBuffer;
+}
+
+/* copy a host string into the string table so the program can read it */
+static void *StdTimeString(Picoc *pc, const char *Result)
+{
+    return Result == NULL ? NULL : (void *)pc->TableStrRegister(Result);
+}
+
+/* read the time_t a program points us at. its time_t is an int, which is narrower than the host's */
+static time_t StdTimeArg(struct ParseState *Parser, struct Value *Arg)
+{
+	Picoc *pc = Parser->pc;
+    int *Time = static_cast<int*>(Arg->getVal<PointerType>(pc));
+    
+    if (Time == NULL)
+        Parser->ProgramFail( "NULL pointer dereference");
+    
+    Parser->VariableCheckRange(Time, sizeof(int));
+    return *Time;
+}
+
+/* check the struct tm a program points us at */
+static struct tm *StdTmArg(struct ParseState *Parser, struct Value *Arg)
+{
+	Picoc *pc = Parser->pc;
+    struct tm *Tm = static_cast<tm*>(Arg->getVal<PointerType>(pc));
+    
+    if (Tm == NULL)
+        Parser->ProgramFail( "NULL pointer dereference");
+    
+    Parser->VariableCheckRange(Tm, sizeof(struct tm));
+    return Tm;
+}
+
 #ifdef CLK_PER_SEC
 static int CLK_PER_SECValue = CLK_PER_SEC;
 #endif
@@ -17,7 +65,7 @@ static int CLK_TCKValue = CLK_TCK;
 void StdAsctime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  asctime(static_cast<tm*>(Param[0]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<PointerType>(pc,  StdTimeString(pc, asctime(StdTmArg(Parser, Param[0]))));
 }
 
 void StdClock(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -29,7 +77,9 @@ void StdClock(struct ParseState *Parser, struct Value *ReturnValue, struct Value
 void StdCtime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  ctime(static_cast<time_t*>(Param[0]->getVal<PointerType>(pc))));
+    time_t Time = StdTimeArg(Parser, Param[0]);
+    
+	ReturnValue->setVal<PointerType>(pc,  StdTimeString(pc, ctime(&Time)));
 }
 
 #ifndef NO_FP
@@ -43,50 +93,70 @@ void StdDifftime(struct ParseState *Parser, struct Value *ReturnValue, struct Va
 void StdGmtime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  gmtime(static_cast<time_t*>(Param[0]->getVal<PointerType>(pc))));
+    time_t Time = StdTimeArg(Parser, Param[0]);
+    
+	ReturnValue->setVal<PointerType>(pc,  StdTimeResult(pc, gmtime(&Time)));
 }
 
 void StdLocaltime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<PointerType>(pc,  localtime(static_cast<time_t*>(Param[0]->getVal<PointerType>(pc))));
+    time_t Time = StdTimeArg(Parser, Param[0]);
+    
+	ReturnValue->setVal<PointerType>(pc,  StdTimeResult(pc, localtime(&Time)));
 }
 
 void StdMktime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, (int)mktime(static_cast<tm*>(Param[0]->getVal<PointerType>(pc))));
+	ReturnValue->setVal<int>(pc, (int)mktime(StdTmArg(Parser, Param[0])));
 }
 
 void StdTime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
-	ReturnValue->setVal<int>(pc, (int)time(static_cast<time_t*>(Param[0]->getVal<PointerType>(pc))));
+    int *Result = static_cast<int*>(Param[0]->getVal<PointerType>(pc));
+    int Now = (int)time(NULL);
+    
+    Parser->VariableCheckRange(Result, sizeof(int));
+    if (Result != NULL)
+        *Result = Now;
+    
+	ReturnValue->setVal<int>(pc, Now);
 }
 
 void StdStrftime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	Picoc *pc = Parser->pc;
+    Parser->VariableCheckRange(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<int>(pc));
+    Parser->VariableCheckString(Param[2]->getVal<char*>(pc));
 	ReturnValue->setVal<int>(pc, strftime(static_cast<char*>(Param[0]->getVal<PointerType>(pc)), Param[1]->getVal<int>(pc), Param[2]->getVal<char*>(pc), 
-		static_cast<tm*>(Param[3]->getVal<PointerType>(pc))));
+		StdTmArg(Parser, Param[3])));
 }
 
 #ifndef WIN32
 void StdStrptime(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
 	  extern char *strptime(const char *s, const char *format, struct tm *tm);
+	Picoc *pc = Parser->pc;
 	  
-    ReturnValue->setVal<PointerType>(pc,  strptime(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<PointerType>(pc), Param[2]->getVal<PointerType>(pc));
+    Parser->VariableCheckString(Param[0]->getVal<char*>(pc));
+    Parser->VariableCheckString(Param[1]->getVal<char*>(pc));
+    ReturnValue->setVal<PointerType>(pc,  strptime(Param[0]->getVal<char*>(pc), Param[1]->getVal<char*>(pc), StdTmArg(Parser, Param[2])));
 }
 
 void StdGmtime_r(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->setVal<PointerType>(pc,  gmtime_r(Param[0]->getVal<PointerType>(pc), Param[1]->getVal<PointerType>(pc));
+	Picoc *pc = Parser->pc;
+    time_t Time = StdTimeArg(Parser, Param[0]);
+    
+    ReturnValue->setVal<PointerType>(pc,  gmtime_r(&Time, StdTmArg(Parser, Param[1])));
 }
 
 void StdTimegm(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->setVal<int>(pc, timegm(Param[0]->getVal<PointerType>(pc)));
+	Picoc *pc = Parser->pc;
+    ReturnValue->setVal<int>(pc, timegm(StdTmArg(Parser, Param[0])));
 }
 #endif
 
@@ -23,25 +23,6 @@ void debugf(char *Format, ...)
 }
 #endif
 
-/* local prototypes  */
-enum OperatorOrder
-{
-    OrderNone,
-    OrderPrefix,
-    OrderInfix,
-    OrderPostfix
-};
-
-/* a stack of expressions we use in evaluation */
-struct ExpressionStack
-{
-    struct ExpressionStack *Next;       /* the next lower item on the stack */
-    struct Value *ExprVal;                  /* the value for this stack node */
-    enum LexToken Op;                   /* the operator */
-    short unsigned int Precedence;      /* the operator precedence of this node */
-    unsigned char Order;                /* the evaluation order of this operator */
-};
-
 /* operator precedence definitions */
 struct OpPrecedence
 {
@@ -76,12 +57,11 @@ static struct OpPrecedence OperatorPrecedence[] =
     /* TokenOpenBracket, */ { 15, 0, 0, "(" }, /* TokenCloseBracket, */ { 0, 15, 0, ")" }
 };
 
-void ExpressionParseFunctionCall(struct ParseState *Parser, struct ExpressionStack **StackTop, const char *FuncName, int RunIt);
-
 #ifdef DEBUG_EXPRESSIONS
 /* show the contents of the expression stack */
-void ExpressionStackShow(Picoc *pc, struct ExpressionStack *StackTop)
+void ExpressionStackShow(Picoc *pc, struct ExpressionStack *Stack)
 {
+    struct ExpressionStackNode *StackTop = Stack->Top();
     printf("Expression stack [0x%lx,0x%lx]: ", (long)pc->HeapStackTop, (long)StackTop);
     
     while (StackTop != NULL)
@@ -133,7 +113,7 @@ void ExpressionStackShow(Picoc *pc, struct ExpressionStack *StackTop)
             printf("[0x%lx]", (long)StackTop);
         }
         
-        StackTop = StackTop->Next;
+        StackTop = Stack->Below(StackTop);
         if (StackTop != NULL)
             printf(", ");
     }
@@ -151,10 +131,9 @@ int ParseState::IsTypeToken(enum LexToken t, struct Value * LexValue)
     /* typedef'ed type? */
     if (t == TokenIdentifier) /* see TypeParseFront, case TokenIdentifier and ParseTypedef */
     {
-        struct Value * VarValue;
-		if (Parser->pc->VariableDefined(static_cast<char*>(LexValue->getVal<PointerType>(pc))))
+        struct Value * VarValue = VariableLookup(Parser->Pos, static_cast<char*>(LexValue->getVal<PointerType>(pc)));
+		if (VarValue != NULL)
         {
-			VariableGet( static_cast<char*>(LexValue->getVal<PointerType>(pc)), &VarValue);
             if (VarValue->TypeOfValue == &Parser->pc->TypeType)
                 return 1;
         }
@@ -287,42 +266,61 @@ double ParseState::ExpressionAssignFP(struct Value *DestValue, double FromFP)
 #endif
 
 /* push a node on to the expression stack */
-void ParseState::ExpressionStackPushValueNode(struct ExpressionStack **StackTop, struct Value *ValueLoc)
+void ParseState::ExpressionStackPushValueNode(struct ExpressionStack *Stack, struct Value *ValueLoc)
 {
 	struct ParseState *Parser = this;
-	struct ExpressionStack *StackNode = static_cast<ExpressionStack*>(VariableAlloc( sizeof(struct ExpressionStack), LocationOnStack));
-    StackNode->Next = *StackTop;
-    StackNode->ExprVal = ValueLoc;
-    *StackTop = StackNode;
-#ifdef FANCY_ERROR_MESSAGES
-    StackNode->Line = Parser->Line;
-    StackNode->CharacterPos = Parser->CharacterPos;
-#endif
+	struct ExpressionStackNode StackNode{ ValueLoc, TokenNone, 0, OrderNone };
+    Stack->Nodes.push_back(StackNode);
 #ifdef DEBUG_EXPRESSIONS
-    ExpressionStackShow(Parser->pc, *StackTop);
+    ExpressionStackShow(Parser->pc, Stack);
 #endif
 }
 
+/* is this type's data kept on the virtual stack when it's a temporary? a struct or union's members can 
+ * be pointed to, as in name().buf, so they have to be in the program's memory */
+static bool ExpressionTemporaryIsVirtual(struct ValueType *Typ)
+{
+    return Typ->Base == TypeStruct || Typ->Base == TypeUnion;
+}
+
 /* push a blank value on to the expression stack by type */
-struct Value *ParseState::ExpressionStackPushValueByType(struct ExpressionStack **StackTop, struct ValueType *PushType)
+struct Value *ParseState::ExpressionStackPushValueByType(struct ExpressionStack *Stack, struct ValueType *PushType)
 {
 	struct ParseState *Parser = this;
-	struct Value *ValueLoc = VariableAllocValueFromType( PushType, FALSE, NULL, LocationOnStack);
-    ExpressionStackPushValueNode( StackTop, ValueLoc);
+	struct Value *ValueLoc = VariableAllocValueFromType( PushType, FALSE, NULL, 
+		ExpressionTemporaryIsVirtual(PushType) ? LocationOnStackVirtual : LocationOnStack);
+    ExpressionStackPushValueNode( Stack, ValueLoc);
+    
+    return ValueLoc;
+}
+
+/* push a value on to the expression stack by type without clearing it. the
+ * caller must assign the whole value straight away */
+struct Value *ParseState::ExpressionStackPushValueByTypeUncleared(struct ExpressionStack *Stack, struct ValueType *PushType)
+{
+	struct Value *ValueLoc;
+	
+	if (ExpressionTemporaryIsVirtual(PushType))
+		ValueLoc = VariableAllocValueFromType( PushType, FALSE, NULL, LocationOnStackVirtual);
+	else
+		ValueLoc = VariableAllocValueFromTypeUncleared( PushType, FALSE, NULL);
+	
+    ExpressionStackPushValueNode( Stack, ValueLoc);
     
     return ValueLoc;
 }
 
 /* push a value on to the expression stack */
-void ParseState::ExpressionStackPushValue(struct ExpressionStack **StackTop, struct Value *PushValue)
+void ParseState::ExpressionStackPushValue(struct ExpressionStack *Stack, struct Value *PushValue)
 {
 	struct ParseState *Parser = this;
 	// obsolete assert(PushValue->isAbsolute);
-	struct Value *ValueLoc = VariableAllocValueAndCopy( PushValue, LocationOnStack);
-    ExpressionStackPushValueNode( StackTop, ValueLoc);
+	struct Value *ValueLoc = VariableAllocValueAndCopy( PushValue, 
+		ExpressionTemporaryIsVirtual(PushValue->TypeOfValue) ? LocationOnStackVirtual : LocationOnStack);
+    ExpressionStackPushValueNode( Stack, ValueLoc);
 }
 
-void ParseState::ExpressionStackPushLValue(struct ExpressionStack **StackTop, struct Value *PushValue, int Offset)
+void ParseState::ExpressionStackPushLValue(struct ExpressionStack *Stack, struct Value *PushValue, int Offset)
 {
 	struct ParseState *Parser = this;
 	UnionAnyValuePointer data;
@@ -336,10 +334,10 @@ void ParseState::ExpressionStackPushLValue(struct ExpressionStack **StackTop, st
 	else {
 		ValueLoc->setValVirtual(pc, data);
 	}
-    ExpressionStackPushValueNode( StackTop, ValueLoc);
+    ExpressionStackPushValueNode( Stack, ValueLoc);
 }
 
-void ParseState::ExpressionStackPushDereference(struct ExpressionStack **StackTop, struct Value *DereferenceValue)
+void ParseState::ExpressionStackPushDereference(struct ExpressionStack *Stack, struct Value *DereferenceValue)
 {
 	struct ParseState *Parser = this;
     struct Value *DerefVal;
@@ -353,24 +351,24 @@ void ParseState::ExpressionStackPushDereference(struct ExpressionStack **StackTo
 
     ValueLoc = Parser->VariableAllocValueFromExistingData( DerefType, (UnionAnyValuePointer )DerefDataLoc, 
 		DerefIsLValue, DerefVal, DereferenceValue->isAbsolute);
-    ExpressionStackPushValueNode( StackTop, ValueLoc);
+    ExpressionStackPushValueNode( Stack, ValueLoc);
 }
 
-void ParseState::ExpressionPushInt(struct ExpressionStack **StackTop, long IntValue)
+void ParseState::ExpressionPushInt(struct ExpressionStack *Stack, long IntValue)
 {
 	struct ParseState *Parser = this;
-	struct Value *ValueLoc = VariableAllocValueFromType( &Parser->pc->IntType, FALSE, NULL, LocationOnStack);
+	struct Value *ValueLoc = VariableAllocValueFromTypeUncleared( &Parser->pc->IntType, FALSE, NULL);
     ValueLoc->setVal<int>(pc, IntValue);
-    ExpressionStackPushValueNode( StackTop, ValueLoc);
+    ExpressionStackPushValueNode( Stack, ValueLoc);
 }
 
 #ifndef NO_FP
-void ParseState::ExpressionPushFP(struct ExpressionStack **StackTop, double FPValue)
+void ParseState::ExpressionPushFP(struct ExpressionStack *Stack, double FPValue)
 {
 	struct ParseState *Parser = this;
-	struct Value *ValueLoc = VariableAllocValueFromType( &Parser->pc->FPType, FALSE, NULL, LocationOnStack);
+	struct Value *ValueLoc = VariableAllocValueFromTypeUncleared( &Parser->pc->FPType, FALSE, NULL);
     ValueLoc->setVal<double>(pc,  FPValue);
-    ExpressionStackPushValueNode(StackTop, ValueLoc);
+    ExpressionStackPushValueNode(Stack, ValueLoc);
 }
 #endif
 
@@ -526,7 +524,7 @@ void ParseState::ExpressionAssign(struct Value *DestValue, struct Value *SourceV
 }
 
 /* evaluate the first half of a ternary operator x ? y : z */
-void ParseState::ExpressionQuestionMarkOperator(struct ExpressionStack **StackTop, struct Value *BottomValue, struct Value *TopValue)
+void ParseState::ExpressionQuestionMarkOperator(struct ExpressionStack *Stack, struct Value *BottomValue, struct Value *TopValue)
 {
 	struct ParseState *Parser = this;
     if (!IS_NUMERIC_COERCIBLE(TopValue))
@@ -535,33 +533,33 @@ void ParseState::ExpressionQuestionMarkOperator(struct ExpressionStack **StackTo
 	if (TopValue->ExpressionCoerceInteger(pc))
     {
         /* the condition's true, return the BottomValue */
-        ExpressionStackPushValue(/*Parser,*/ StackTop, BottomValue);
+        ExpressionStackPushValue(/*Parser,*/ Stack, BottomValue);
     }
     else
     {
         /* the condition's false, return void */
-        ExpressionStackPushValueByType(/*Parser,*/ StackTop, &Parser->pc->VoidType);
+        ExpressionStackPushValueByType(/*Parser,*/ Stack, &Parser->pc->VoidType);
     }
 }
 
 /* evaluate the second half of a ternary operator x ? y : z */
-void ParseState::ExpressionColonOperator(struct ExpressionStack **StackTop, struct Value *BottomValue, struct Value *TopValue)
+void ParseState::ExpressionColonOperator(struct ExpressionStack *Stack, struct Value *BottomValue, struct Value *TopValue)
 {
 	struct ParseState *Parser = this;
     if (TopValue->TypeOfValue->Base == TypeVoid)
     {
         /* invoke the "else" part - return the BottomValue */
-        ExpressionStackPushValue(/*Parser,*/ StackTop, BottomValue);
+        ExpressionStackPushValue(/*Parser,*/ Stack, BottomValue);
     }
     else
     {
         /* it was a "then" - return the TopValue */
-        ExpressionStackPushValue(/*Parser,*/ StackTop, TopValue);
+        ExpressionStackPushValue(/*Parser,*/ Stack, TopValue);
     }
 }
 
 /* evaluate a prefix operator */
-void ParseState::ExpressionPrefixOperator(struct ExpressionStack **StackTop, enum LexToken Op, struct Value *TopValue)
+void ParseState::ExpressionPrefixOperator(struct ExpressionStack *Stack, enum LexToken Op, struct Value *TopValue)
 {
 	struct ParseState *Parser = this;
     struct Value *Result;
@@ -582,19 +580,19 @@ void ParseState::ExpressionPrefixOperator(struct ExpressionStack **StackTop, enu
 		Result = VariableAllocValueFromType(TypeGetMatching( TopValue->TypeOfValue, TypePointer,
 			0, Parser->pc->StrEmpty, TRUE), FALSE, NULL, LocationOnStack);
             Result->setVal<PointerType>(pc,  (void *)ValPtr);
-            ExpressionStackPushValueNode(/*Parser,*/ StackTop, Result);
+            ExpressionStackPushValueNode(/*Parser,*/ Stack, Result);
             break;
 
         case TokenAsterisk:
-            ExpressionStackPushDereference(/*Parser,*/ StackTop, TopValue);
+            ExpressionStackPushDereference(/*Parser,*/ Stack, TopValue);
             break;
         
         case TokenSizeof:
             /* return the size of the argument */
             if (TopValue->TypeOfValue == &Parser->pc->TypeType)
-                ExpressionPushInt(/*Parser,*/ StackTop, TypeSize(TopValue->getVal<struct ValueType*>(pc), TopValue->getVal<struct ValueType*>(pc)->ArraySize, TRUE));
+                ExpressionPushInt(/*Parser,*/ Stack, TypeSize(TopValue->getVal<struct ValueType*>(pc), TopValue->getVal<struct ValueType*>(pc)->ArraySize, TRUE));
             else
-                ExpressionPushInt(/*Parser,*/ StackTop, TypeSize(TopValue->TypeOfValue, TopValue->TypeOfValue->ArraySize, TRUE));
+                ExpressionPushInt(/*Parser,*/ Stack, TypeSize(TopValue->TypeOfValue, TopValue->TypeOfValue->ArraySize, TRUE));
             break;
         
         default:
@@ -615,7 +613,7 @@ void ParseState::ExpressionPrefixOperator(struct ExpressionStack **StackTop, enu
                     default:                Parser->ProgramFail( "invalid operation"); break;
                 }
                 
-                ExpressionPushFP(/*Parser,*/ StackTop, ResultFP);
+                ExpressionPushFP(/*Parser,*/ Stack, ResultFP);
             }
             else 
 #endif
@@ -635,7 +633,7 @@ void ParseState::ExpressionPrefixOperator(struct ExpressionStack **StackTop, enu
                     default:                Parser->ProgramFail( "invalid operation"); break;
                 }
 
-                ExpressionPushInt(/*Parser,*/ StackTop, ResultInt);
+                ExpressionPushInt(/*Parser,*/ Stack, ResultInt);
             }
             else if (TopValue->TypeOfValue->Base == TypePointer)
             {
@@ -658,7 +656,7 @@ void ParseState::ExpressionPrefixOperator(struct ExpressionStack **StackTop, enu
                 }
 
                 ResultPtr = TopValue->getVal<PointerType>(pc);
-                StackValue = ExpressionStackPushValueByType(/*Parser,*/ StackTop, TopValue->TypeOfValue);
+                StackValue = ExpressionStackPushValueByTypeUncleared(/*Parser,*/ Stack, TopValue->TypeOfValue);
                 StackValue->setVal<PointerType>(pc,  ResultPtr);
             }
             else
@@ -668,7 +666,7 @@ void ParseState::ExpressionPrefixOperator(struct ExpressionStack **StackTop, enu
 }
 
 /* evaluate a postfix operator */
-void ParseState::ExpressionPostfixOperator(struct ExpressionStack **StackTop, enum LexToken Op, struct Value *TopValue)
+void ParseState::ExpressionPostfixOperator(struct ExpressionStack *Stack, enum LexToken Op, struct Value *TopValue)
 {
 	struct ParseState *Parser = this;
     debugf("ExpressionPostfixOperator()\n");
@@ -685,7 +683,7 @@ void ParseState::ExpressionPostfixOperator(struct ExpressionStack **StackTop, en
             default:                Parser->ProgramFail( "invalid operation"); break;
         }
         
-        ExpressionPushFP(/*Parser,*/ StackTop, ResultFP);
+        ExpressionPushFP(/*Parser,*/ Stack, ResultFP);
     }
     else 
 #endif
@@ -702,7 +700,7 @@ void ParseState::ExpressionPostfixOperator(struct ExpressionStack **StackTop, en
             default:                        Parser->ProgramFail( "invalid operation"); break;
         }
     
-        ExpressionPushInt(/*Parser,*/ StackTop, ResultInt);
+        ExpressionPushInt(/*Parser,*/ Stack, ResultInt);
     }
     else if (TopValue->TypeOfValue->Base == TypePointer)
     {
@@ -724,7 +722,7 @@ void ParseState::ExpressionPostfixOperator(struct ExpressionStack **StackTop, en
             default:                Parser->ProgramFail( "invalid operation"); break;
         }
         
-        StackValue = ExpressionStackPushValueByType(/*Parser,*/ StackTop, TopValue->TypeOfValue);
+        StackValue = ExpressionStackPushValueByTypeUncleared(/*Parser,*/ Stack, TopValue->TypeOfValue);
         StackValue->setVal<PointerType>(pc,  OrigPointer);
     }
     else
@@ -732,7 +730,7 @@ void ParseState::ExpressionPostfixOperator(struct ExpressionStack **StackTop, en
 }
 
 /* evaluate an infix operator */
-void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum LexToken Op, struct Value *BottomValue, struct Value *TopValue)
+void ParseState::ExpressionInfixOperator(struct ExpressionStack *Stack, enum LexToken Op, struct Value *BottomValue, struct Value *TopValue)
 {
 	struct ParseState *Parser = this;
     long ResultInt = 0;
@@ -758,28 +756,45 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
         switch (BottomValue->TypeOfValue->Base)
         {
             case TypeArray:   
+            {
+                char *Element = BottomValue->ValAddressOfData(pc) + TypeSize(BottomValue->TypeOfValue, ArrayIndex, TRUE);
+                
+                /* an array of known size is bounded by it, otherwise the element has to be in the program's memory */
+                if (BottomValue->TypeOfValue->ArraySize > 0)
+                {
+                    if (ArrayIndex < 0 || ArrayIndex >= BottomValue->TypeOfValue->ArraySize)
+                        Parser->ProgramFail( "illegal array index %d [0..%d]", ArrayIndex, BottomValue->TypeOfValue->ArraySize-1);
+                }
+                else if (!BottomValue->isAbsolute)
+                    Parser->VariableCheckPointer(Element, BottomValue->TypeOfValue->FromType);
+                
 				Result = Parser->VariableAllocValueFromExistingData( BottomValue->TypeOfValue->FromType, 
-								(UnionAnyValuePointer )(BottomValue->ValAddressOfData(pc) + 
-								TypeSize(BottomValue->TypeOfValue, ArrayIndex, TRUE)),
+								(UnionAnyValuePointer )Element,
 								BottomValue->IsLValue, BottomValue->LValueFrom, BottomValue->isAbsolute);
 				break;
+            }
             case TypePointer: 
+            {
+                char *Element = (char *)BottomValue->getVal<PointerType>(pc) + 
+                                  TypeSize(BottomValue->TypeOfValue->FromType, 0, TRUE) * ArrayIndex;
+                
+                Parser->VariableCheckPointer(Element, BottomValue->TypeOfValue->FromType);
 				Result = Parser->VariableAllocValueFromExistingData( BottomValue->TypeOfValue->FromType, 
-								(UnionAnyValuePointer )((char *)BottomValue->getVal<PointerType>(pc) + 
-								  TypeSize(BottomValue->TypeOfValue->FromType, 0, TRUE) * ArrayIndex), 
+								(UnionAnyValuePointer )Element, 
 								  BottomValue->IsLValue, BottomValue->LValueFrom, BottomValue->isAbsolute);
 				break;
+            }
             default:          
 				Parser->ProgramFail( "this %t is not an array", BottomValue->TypeOfValue);
         }
         
-        ExpressionStackPushValueNode(/*Parser,*/ StackTop, Result);
+        ExpressionStackPushValueNode(/*Parser,*/ Stack, Result);
     }
     else if (Op == TokenQuestionMark)
-        ExpressionQuestionMarkOperator(/*Parser,*/ StackTop, TopValue, BottomValue);
+        ExpressionQuestionMarkOperator(/*Parser,*/ Stack, TopValue, BottomValue);
     
     else if (Op == TokenColon)
-        ExpressionColonOperator(/*Parser,*/ StackTop, TopValue, BottomValue);
+        ExpressionColonOperator(/*Parser,*/ Stack, TopValue, BottomValue);
         
 #ifndef NO_FP
     else if ( (TopValue->TypeOfValue == &Parser->pc->FPType && BottomValue->TypeOfValue == &Parser->pc->FPType) ||
@@ -817,9 +832,9 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
         }
 
         if (ResultIsInt)
-            ExpressionPushInt(/*Parser,*/ StackTop, ResultInt);
+            ExpressionPushInt(/*Parser,*/ Stack, ResultInt);
         else
-            ExpressionPushFP(/*Parser,*/ StackTop, ResultFP);
+            ExpressionPushFP(/*Parser,*/ Stack, ResultFP);
     }
 #endif
     else if (IS_NUMERIC_COERCIBLE(TopValue) && IS_NUMERIC_COERCIBLE(BottomValue))
@@ -869,7 +884,7 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
             default:                        Parser->ProgramFail( "invalid operation"); break;
         }
         
-        ExpressionPushInt(/*Parser,*/ StackTop, ResultInt);
+        ExpressionPushInt(/*Parser,*/ Stack, ResultInt);
     }
     else if (BottomValue->TypeOfValue->Base == TypePointer && IS_NUMERIC_COERCIBLE(TopValue))
     {
@@ -883,9 +898,9 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
                 Parser->ProgramFail( "invalid operation");
             
             if (Op == TokenEqual)
-                ExpressionPushInt(/*Parser,*/ StackTop, BottomValue->getVal<PointerType>(pc) == NULL);
+                ExpressionPushInt(/*Parser,*/ Stack, BottomValue->getVal<PointerType>(pc) == NULL);
             else
-                ExpressionPushInt(/*Parser,*/ StackTop, BottomValue->getVal<PointerType>(pc) != NULL);
+                ExpressionPushInt(/*Parser,*/ Stack, BottomValue->getVal<PointerType>(pc) != NULL);
         }
         else if (Op == TokenPlus || Op == TokenMinus)
         {
@@ -901,15 +916,14 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
             else
                 PointerLoc = (void *)((char *)PointerLoc - TopInt * Size);
             
-            StackValue = ExpressionStackPushValueByType(/*Parser,*/ StackTop, BottomValue->TypeOfValue);
+            StackValue = ExpressionStackPushValueByTypeUncleared(/*Parser,*/ Stack, BottomValue->TypeOfValue);
             StackValue->setVal<PointerType>(pc,  PointerLoc);
         }
         else if (Op == TokenAssign && TopInt == 0)
         {
             /* assign a NULL pointer */
-			Parser->pc->HeapUnpopStack( sizeof(struct Value));
             Parser->ExpressionAssign( BottomValue, TopValue, FALSE, NULL, 0, FALSE);
-            ExpressionStackPushValueNode(/*Parser,*/ StackTop, BottomValue);
+            ExpressionStackPushValueNode(/*Parser,*/ Stack, BottomValue);
         }
         else if (Op == TokenAddAssign || Op == TokenSubtractAssign)
         {
@@ -925,9 +939,8 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
             else
                 PointerLoc = (void *)((char *)PointerLoc - TopInt * Size);
 
-			Parser->pc->HeapUnpopStack(sizeof(struct Value));
             BottomValue->setVal<PointerType>(pc,  PointerLoc);
-            ExpressionStackPushValueNode(/*Parser,*/ StackTop, BottomValue);
+            ExpressionStackPushValueNode(/*Parser,*/ Stack, BottomValue);
         }
         else
             Parser->ProgramFail( "invalid operation");
@@ -940,23 +953,22 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
         
         switch (Op)
         {
-            case TokenEqual:                ExpressionPushInt(/*Parser,*/ StackTop, BottomLoc == TopLoc); break;
-            case TokenNotEqual:             ExpressionPushInt(/*Parser,*/ StackTop, BottomLoc != TopLoc); break;
-            case TokenMinus:                ExpressionPushInt(/*Parser,*/ StackTop, BottomLoc - TopLoc); break;
+            case TokenEqual:                ExpressionPushInt(/*Parser,*/ Stack, BottomLoc == TopLoc); break;
+            case TokenNotEqual:             ExpressionPushInt(/*Parser,*/ Stack, BottomLoc != TopLoc); break;
+            case TokenMinus:                ExpressionPushInt(/*Parser,*/ Stack, BottomLoc - TopLoc); break;
             default:                        Parser->ProgramFail( "invalid operation"); break;
         }
     }
     else if (Op == TokenAssign)
     {
         /* assign a non-numeric type */
-		Parser->pc->HeapUnpopStack( sizeof(struct Value));   /* XXX - possible bug if lvalue is a temp value and takes more than sizeof(struct Value) */
         Parser->ExpressionAssign( BottomValue, TopValue, FALSE, NULL, 0, FALSE);
-        ExpressionStackPushValueNode(/*Parser,*/ StackTop, BottomValue);
+        ExpressionStackPushValueNode(/*Parser,*/ Stack, BottomValue);
     }
     else if (Op == TokenCast)
     {
         /* cast a value to a different type */   /* XXX - possible bug if the destination type takes more than sizeof(struct Value) + sizeof(struct ValueType *) */
-        struct Value *ValueLoc = ExpressionStackPushValueByType(/*Parser,*/ StackTop, BottomValue->getVal<struct ValueType*>(pc));
+        struct Value *ValueLoc = ExpressionStackPushValueByTypeUncleared(/*Parser,*/ Stack, BottomValue->getVal<struct ValueType*>(pc));
         Parser->ExpressionAssign( ValueLoc, TopValue, TRUE, NULL, 0, TRUE);
     }
     else
@@ -964,24 +976,25 @@ void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum
 }
 
 /* take the contents of the expression stack and compute the top until there's nothing greater than the given precedence */
-void ParseState::ExpressionStackCollapse(struct ExpressionStack **StackTop, int Precedence, int *IgnorePrecedence)
+void ParseState::ExpressionStackCollapse(struct ExpressionStack *Stack, int Precedence, int *IgnorePrecedence)
 {
 	struct ParseState *Parser = this;
     int FoundPrecedence = Precedence;
     struct Value *TopValue;
     struct Value *BottomValue;
-    struct ExpressionStack *TopStackNode = *StackTop;
-    struct ExpressionStack *TopOperatorNode;
+    struct ExpressionStackNode *TopStackNode = Stack->Top();
+    struct ExpressionStackNode *TopOperatorNode;
+    enum LexToken Op;
     
     debugf("ExpressionStackCollapse(%d):\n", Precedence);
 #ifdef DEBUG_EXPRESSIONS
-    ExpressionStackShow(Parser->pc, *StackTop);
+    ExpressionStackShow(Parser->pc, Stack);
 #endif
-    while (TopStackNode != NULL && TopStackNode->Next != NULL && FoundPrecedence >= Precedence)
+    while (TopStackNode != NULL && Stack->Below(TopStackNode) != NULL && FoundPrecedence >= Precedence)
     {
         /* find the top operator on the stack */
         if (TopStackNode->Order == OrderNone)
-            TopOperatorNode = TopStackNode->Next;
+            TopOperatorNode = Stack->Below(TopStackNode);
         else
             TopOperatorNode = TopStackNode;
         
@@ -990,7 +1003,8 @@ void ParseState::ExpressionStackCollapse(struct ExpressionStack **StackTop, int
         /* does it have a high enough precedence? */
         if (FoundPrecedence >= Precedence && TopOperatorNode != NULL)
         {
-            /* execute this operator */
+            /* execute this operator. the nodes are popped first so take the operator now */
+            Op = TopOperatorNode->Op;
             switch (TopOperatorNode->Order)
             {
                 case OrderPrefix:
@@ -998,46 +1012,40 @@ void ParseState::ExpressionStackCollapse(struct ExpressionStack **StackTop, int
                     debugf("prefix evaluation\n");
                     TopValue = TopStackNode->ExprVal;
                     
-                    /* pop the value and then the prefix operator - assume they'll still be there until we're done */
-					Parser->pc->HeapPopStack(NULL, sizeof(struct ExpressionStack) + 
-						sizeof(struct Value) + TopValue->TypeStackSizeValue());
-					Parser->pc->HeapPopStack( TopOperatorNode, sizeof(struct ExpressionStack));
-                    *StackTop = TopOperatorNode->Next;
+                    /* pop the value and then the prefix operator. the value itself stays allocated until the expression's mark is reset */
+                    Stack->Pop(2);
                     
                     /* do the prefix operation */
                     if (Parser->Mode == RunModeRun /* && FoundPrecedence < *IgnorePrecedence */)
                     {
                         /* run the operator */
-                        ExpressionPrefixOperator(/*Parser,*/ StackTop, TopOperatorNode->Op, TopValue);
+                        ExpressionPrefixOperator(/*Parser,*/ Stack, Op, TopValue);
                     }
                     else
                     {
                         /* we're not running it so just return 0 */
-                        ExpressionPushInt(/*Parser,*/ StackTop, 0);
+                        ExpressionPushInt(/*Parser,*/ Stack, 0);
                     }
                     break;
                 
                 case OrderPostfix:
                     /* postfix evaluation */
                     debugf("postfix evaluation\n");
-                    TopValue = TopStackNode->Next->ExprVal;
+                    TopValue = Stack->Below(TopStackNode)->ExprVal;
                     
-                    /* pop the postfix operator and then the value - assume they'll still be there until we're done */
-					Parser->pc->HeapPopStack( nullptr, sizeof(struct ExpressionStack));
-					Parser->pc->HeapPopStack(TopValue, sizeof(struct ExpressionStack) + 
-						sizeof(struct Value) + TopValue->TypeStackSizeValue());
-                    *StackTop = TopStackNode->Next->Next;
+                    /* pop the postfix operator and then the value */
+                    Stack->Pop(2);
 
                     /* do the postfix operation */
                     if (Parser->Mode == RunModeRun /* && FoundPrecedence < *IgnorePrecedence */)
                     {
                         /* run the operator */
-                        ExpressionPostfixOperator(/*Parser,*/ StackTop, TopOperatorNode->Op, TopValue);
+                        ExpressionPostfixOperator(/*Parser,*/ Stack, Op, TopValue);
                     }
                     else
                     {
                         /* we're not running it so just return 0 */
-                        ExpressionPushInt(/*Parser,*/ StackTop, 0);
+                        ExpressionPushInt(/*Parser,*/ Stack, 0);
                     }
                     break;
                 
@@ -1047,32 +1055,21 @@ void ParseState::ExpressionStackCollapse(struct ExpressionStack **StackTop, int
                     TopValue = TopStackNode->ExprVal;
                     if (TopValue != NULL)
                     {
-                        BottomValue = TopOperatorNode->Next->ExprVal;
+                        BottomValue = Stack->Below(TopOperatorNode)->ExprVal;
                         
-                        /* pop a value, the operator and another value - assume they'll still be there until we're done */
-						Parser->pc->HeapPopStack(NULL, sizeof(struct ExpressionStack) + sizeof(struct Value) + 
-							TopValue->TypeStackSizeValue());
-						Parser->pc->HeapPopStack( NULL, sizeof(struct ExpressionStack));
-						//assert(BottomValue->isAbsolute);
-						if (BottomValue->isAbsolute){
-							Parser->pc->HeapPopStack(BottomValue, sizeof(struct ExpressionStack) + sizeof(struct Value) +
-								BottomValue->TypeStackSizeValue());
-						}
-						else {
-							Parser->pc->HeapPopStack(BottomValue, sizeof(struct ExpressionStack) + sizeof(struct Value) ); // ?bug here is injected
-						}
-                        *StackTop = TopOperatorNode->Next->Next;
+                        /* pop a value, the operator and another value */
+                        Stack->Pop(3);
                         
                         /* do the infix operation */
                         if (Parser->Mode == RunModeRun /* && FoundPrecedence <= *IgnorePrecedence */)
                         {
                             /* run the operator */
-                            ExpressionInfixOperator(/*Parser,*/ StackTop, TopOperatorNode->Op, BottomValue, TopValue);
+                            ExpressionInfixOperator(/*Parser,*/ Stack, Op, BottomValue, TopValue);
                         }
                         else
                         {
                             /* we're not running it so just return 0 */
-                            ExpressionPushInt(/*Parser,*/ StackTop, 0);
+                            ExpressionPushInt(/*Parser,*/ Stack, 0);
                         }
                     }
                     else
@@ -1090,38 +1087,30 @@ void ParseState::ExpressionStackCollapse(struct ExpressionStack **StackTop, int
                 *IgnorePrecedence = DEEP_PRECEDENCE;
         }
 #ifdef DEBUG_EXPRESSIONS
-        ExpressionStackShow(Parser->pc, *StackTop);
+        ExpressionStackShow(Parser->pc, Stack);
 #endif
-        TopStackNode = *StackTop;
+        TopStackNode = Stack->Top();
     }
     debugf("ExpressionStackCollapse() finished\n");
 #ifdef DEBUG_EXPRESSIONS
-    ExpressionStackShow(Parser->pc, *StackTop);
+    ExpressionStackShow(Parser->pc, Stack);
 #endif
 }
 
 /* push an operator on to the expression stack */
-void ParseState::ExpressionStackPushOperator(struct ExpressionStack **StackTop, enum OperatorOrder Order, enum LexToken Token, int Precedence)
+void ParseState::ExpressionStackPushOperator(struct ExpressionStack *Stack, enum OperatorOrder Order, enum LexToken Token, int Precedence)
 {
 	struct ParseState *Parser = this;
-	struct ExpressionStack *StackNode = static_cast<ExpressionStack*>(VariableAlloc(sizeof(struct ExpressionStack), LocationOnStack));
-    StackNode->Next = *StackTop;
-    StackNode->Order = Order;
-    StackNode->Op = Token;
-    StackNode->Precedence = Precedence;
-    *StackTop = StackNode;
+	struct ExpressionStackNode StackNode{ NULL, Token, (short unsigned int)Precedence, (unsigned char)Order };
+    Stack->Nodes.push_back(StackNode);
     debugf("ExpressionStackPushOperator()\n");
-#ifdef FANCY_ERROR_MESSAGES
-    StackNode->Line = Parser->Line;
-    StackNode->CharacterPos = Parser->CharacterPos;
-#endif
 #ifdef DEBUG_EXPRESSIONS
-    ExpressionStackShow(Parser->pc, *StackTop);
+    ExpressionStackShow(Parser->pc, Stack);
 #endif
 }
 
 /* do the '.' and '->' operators */
-void ParseState::ExpressionGetStructElement(struct ExpressionStack **StackTop, enum LexToken Token)
+void ParseState::ExpressionGetStructElement(struct ExpressionStack *Stack, enum LexToken Token)
 {
 	struct ParseState *Parser = this;
     struct ValueAbs *Ident;
@@ -1133,11 +1122,11 @@ void ParseState::ExpressionGetStructElement(struct ExpressionStack **StackTop, e
     if (Parser->Mode == RunModeRun)
     { 
         /* look up the struct element */
-        struct Value *ParamVal = (*StackTop)->ExprVal;
+        struct Value *ParamVal = Stack->Top()->ExprVal;
         struct Value *StructVal = ParamVal;
         struct ValueType *StructType = ParamVal->TypeOfValue;
 		void *DerefDataLoc = static_cast<void *>(ParamVal->isAbsolute ? ParamVal->getValAbsolute() : ParamVal->getValVirtual());
-        struct Value *MemberValue = NULL;
+        struct StructMember *Member;
         struct Value *Result;
 
         /* if we're doing '->' dereference the struct pointer first */
@@ -1148,22 +1137,42 @@ void ParseState::ExpressionGetStructElement(struct ExpressionStack **StackTop, e
             Parser->ProgramFail( "can't use '%s' on something that's not a struct or union %s : it's a %t", 
 			(Token == TokenDot) ? "." : "->", (Token == TokenArrow) ? "pointer" : "", ParamVal->TypeOfValue);
             
-		if (!StructType->Members->TableGet(Ident->ValIdentifierOfAnyValue(pc), &MemberValue, NULL, NULL, NULL))
+		if (StructType->Members == NULL || (Member = StructType->Members->MemberFind(Ident->ValIdentifierOfAnyValue(pc))) == NULL)
 			Parser->ProgramFail("doesn't have a member called '%s'", Ident->ValIdentifierOfAnyValue(pc));
         
-        /* pop the value - assume it'll still be there until we're done */
-		Parser->pc->HeapPopStack(ParamVal, sizeof(struct ExpressionStack) + sizeof(struct Value) + 
-			StructVal->TypeStackSizeValue());
-        *StackTop = (*StackTop)->Next;
+        /* pop the value */
+        Stack->Pop(1);
         
         /* make the result value for this member only */
-        Result = Parser->VariableAllocValueFromExistingData( MemberValue->TypeOfValue, 
-			static_cast<UnionAnyValuePointer >(static_cast<void*>(static_cast<char*>(DerefDataLoc) + MemberValue->getVal<int>(pc))), 
-			TRUE, (StructVal != NULL) ? StructVal->LValueFrom : NULL,MemberValue->isAbsolute);
-        ExpressionStackPushValueNode(/*Parser,*/ StackTop, Result);
+        Result = Parser->VariableAllocValueFromExistingData( Member->Typ, 
+			static_cast<UnionAnyValuePointer >(static_cast<void*>(static_cast<char*>(DerefDataLoc) + Member->Offset)), 
+			TRUE, (StructVal != NULL) ? StructVal->LValueFrom : NULL, true);
+        ExpressionStackPushValueNode(/*Parser,*/ Stack, Result);
     }
 }
 
+/* takes the expression stack for the next nesting depth and gives it back
+ * however ExpressionParse() is left */
+struct ExpressionStackClaim
+{
+    Picoc *pc;
+    struct ExpressionStack *Stack;
+
+    ExpressionStackClaim(Picoc *pc) : pc(pc)
+    {
+        if (pc->ExpressionDepth == (int)pc->ExpressionStacks.size())
+            pc->ExpressionStacks.emplace_back();
+
+        Stack = &pc->ExpressionStacks[pc->ExpressionDepth++];
+        Stack->Nodes.clear();
+    }
+
+    ~ExpressionStackClaim()
+    {
+        pc->ExpressionDepth--;
+    }
+};
+
 /* parse an expression with operator precedence */
 int ParseState::ExpressionParse(struct Value **Result)
 {
@@ -1175,7 +1184,9 @@ int ParseState::ExpressionParse(struct Value **Result)
     int LocalPrecedence;
     int Precedence = 0;
     int IgnorePrecedence = DEEP_PRECEDENCE;
-    struct ExpressionStack *StackTop = NULL;
+    struct ExpressionStackClaim Claim(pc);
+    struct ExpressionStack *Stack = Claim.Stack;
+    struct ExpressionStackNode *StackTop;
     int TernaryDepth = 0;
     
     debugf("ExpressionParse():\n");
@@ -1204,7 +1215,7 @@ int ParseState::ExpressionParse(struct Value **Result)
                 { 
                     /* it's either a new bracket level or a cast */
                     enum LexToken BracketToken = Parser->LexGetToken( &LexValue, FALSE);
-                    if (IsTypeToken(/*Parser,*/ BracketToken, LexValue) && (StackTop == NULL || StackTop->Op != TokenSizeof) )
+                    if (IsTypeToken(/*Parser,*/ BracketToken, LexValue) && (Stack->Top() == NULL || Stack->Top()->Op != TokenSizeof) )
                     {
                         /* it's a cast - get the new type */
                         struct ValueType *CastType;
@@ -1218,11 +1229,11 @@ int ParseState::ExpressionParse(struct Value **Result)
                         /* scan and collapse the stack to the precedence of this infix cast operator, then push */
                         Precedence = BracketPrecedence + OperatorPrecedence[(int)TokenCast].PrefixPrecedence;
 
-                        ExpressionStackCollapse(/*Parser,*/ &StackTop, Precedence+1, &IgnorePrecedence);
-						CastTypeValue = VariableAllocValueFromType(&Parser->pc->TypeType, FALSE, NULL, LocationOnStack);
+                        ExpressionStackCollapse(/*Parser,*/ Stack, Precedence+1, &IgnorePrecedence);
+						CastTypeValue = VariableAllocValueFromTypeUncleared(&Parser->pc->TypeType, FALSE, NULL);
                         CastTypeValue->setVal<struct ValueType*>(pc, CastType);
-                        ExpressionStackPushValueNode(/*Parser,*/ &StackTop, CastTypeValue);
-                        ExpressionStackPushOperator(/*Parser,*/ &StackTop, OrderInfix, TokenCast, Precedence);
+                        ExpressionStackPushValueNode(/*Parser,*/ Stack, CastTypeValue);
+                        ExpressionStackPushOperator(/*Parser,*/ Stack, OrderInfix, TokenCast, Precedence);
                     }
                     else
                     {
@@ -1247,8 +1258,8 @@ int ParseState::ExpressionParse(struct Value **Result)
                             TempPrecedenceBoost = -1;
                     }
 
-                    ExpressionStackCollapse(/*Parser,*/ &StackTop, Precedence, &IgnorePrecedence);
-                    ExpressionStackPushOperator(/*Parser,*/ &StackTop, OrderPrefix, Token, Precedence + TempPrecedenceBoost);
+                    ExpressionStackCollapse(/*Parser,*/ Stack, Precedence, &IgnorePrecedence);
+                    ExpressionStackPushOperator(/*Parser,*/ Stack, OrderPrefix, Token, Precedence + TempPrecedenceBoost);
                 }
             }
             else
@@ -1269,7 +1280,7 @@ int ParseState::ExpressionParse(struct Value **Result)
                             else
                             {
                                 /* collapse to the bracket precedence */
-                                ExpressionStackCollapse(/*Parser,*/ &StackTop, BracketPrecedence, &IgnorePrecedence);
+                                ExpressionStackCollapse(/*Parser,*/ Stack, BracketPrecedence, &IgnorePrecedence);
                                 BracketPrecedence -= BRACKET_PRECEDENCE;
                             }    
                             break;
@@ -1277,8 +1288,8 @@ int ParseState::ExpressionParse(struct Value **Result)
                         default:
                             /* scan and collapse the stack to the precedence of this operator, then push */
                             Precedence = BracketPrecedence + OperatorPrecedence[(int)Token].PostfixPrecedence;
-                            ExpressionStackCollapse(/*Parser,*/ &StackTop, Precedence, &IgnorePrecedence);
-                            ExpressionStackPushOperator(/*Parser,*/ &StackTop, OrderPostfix, Token, Precedence);
+                            ExpressionStackCollapse(/*Parser,*/ Stack, Precedence, &IgnorePrecedence);
+                            ExpressionStackPushOperator(/*Parser,*/ Stack, OrderPostfix, Token, Precedence);
                             break;
                     }
                 }
@@ -1290,27 +1301,27 @@ int ParseState::ExpressionParse(struct Value **Result)
                     /* for right to left order, only go down to the next higher precedence so we evaluate it in reverse order */
                     /* for left to right order, collapse down to this precedence so we evaluate it in forward order */
                     if (IS_LEFT_TO_RIGHT(OperatorPrecedence[(int)Token].InfixPrecedence))
-                        ExpressionStackCollapse(/*Parser,*/ &StackTop, Precedence, &IgnorePrecedence);
+                        ExpressionStackCollapse(/*Parser,*/ Stack, Precedence, &IgnorePrecedence);
                     else
-                        ExpressionStackCollapse(/*Parser,*/ &StackTop, Precedence+1, &IgnorePrecedence);
+                        ExpressionStackCollapse(/*Parser,*/ Stack, Precedence+1, &IgnorePrecedence);
                         
                     if (Token == TokenDot || Token == TokenArrow)
                     {
-                        ExpressionGetStructElement(/*Parser,*/ &StackTop, Token); /* this operator is followed by a struct element so handle it as a special case */
+                        ExpressionGetStructElement(/*Parser,*/ Stack, Token); /* this operator is followed by a struct element so handle it as a special case */
                     }
                     else
                     { 
                         /* if it's a && or || operator we may not need to evaluate the right hand side of the expression */
-                        if ( (Token == TokenLogicalOr || Token == TokenLogicalAnd) && IS_NUMERIC_COERCIBLE(StackTop->ExprVal))
+                        if ( (Token == TokenLogicalOr || Token == TokenLogicalAnd) && IS_NUMERIC_COERCIBLE(Stack->Top()->ExprVal))
                         {
-							long LHSInt = StackTop->ExprVal->ExpressionCoerceInteger(pc);
+							long LHSInt = Stack->Top()->ExprVal->ExpressionCoerceInteger(pc);
                             if ( ( (Token == TokenLogicalOr && LHSInt) || (Token == TokenLogicalAnd && !LHSInt) ) &&
                                  (IgnorePrecedence > Precedence) )
                                 IgnorePrecedence = Precedence;
                         }
                         
                         /* push the operator on the stack */
-                        ExpressionStackPushOperator(/*Parser,*/ &StackTop, OrderInfix, Token, Precedence);
+                        ExpressionStackPushOperator(/*Parser,*/ Stack, OrderInfix, Token, Precedence);
                         PrefixState = TRUE;
                         
                         switch (Token)
@@ -1340,15 +1351,16 @@ int ParseState::ExpressionParse(struct Value **Result)
                 
             if (Parser->LexGetToken( NULL, FALSE) == TokenOpenBracket)
             {
-				ExpressionParseFunctionCall(/*Parser,*/ &StackTop, LexValue->ValIdentifierOfAnyValue(pc), Parser->Mode == RunModeRun && Precedence < IgnorePrecedence);
+				ExpressionParseFunctionCall(/*Parser,*/ Stack, LexValue->ValIdentifierOfAnyValue(pc), Parser->Mode == RunModeRun && Precedence < IgnorePrecedence);
             }
             else
             {
                 if (Parser->Mode == RunModeRun /* && Precedence < IgnorePrecedence */)
                 {
-                    struct ValueAbs *VariableValue = NULL;
+                    struct ValueAbs *VariableValue = static_cast<struct ValueAbs *>(VariableLookup(PreState.Pos, LexValue->ValIdentifierOfAnyValue(pc)));
                     
-					VariableGet(LexValue->ValIdentifierOfAnyValue(pc), &VariableValue);
+                    if (VariableValue == NULL)
+						VariableGet(LexValue->ValIdentifierOfAnyValue(pc), &VariableValue);  /* fails with the right message */
                     if (VariableValue->TypeOfValue->Base == TypeMacro)
                     {
                         /* evaluate a macro as a kind of simple subroutine */
@@ -1363,15 +1375,15 @@ int ParseState::ExpressionParse(struct Value **Result)
 						if (!MacroParser.ExpressionParse(&MacroResult) || MacroParser.LexGetToken(NULL, FALSE) != TokenEndOfFunction)
 							MacroParser.ProgramFail("expression expected");
                         
-                        ExpressionStackPushValueNode( &StackTop, MacroResult);
+                        ExpressionStackPushValueNode( Stack, MacroResult);
                     }
                     else if (VariableValue->TypeOfValue == &Parser->pc->VoidType)
                         Parser->ProgramFail( "a void value isn't much use here");
                     else
-                        ExpressionStackPushLValue( &StackTop, VariableValue, 0); /* it's a value variable */
+                        ExpressionStackPushLValue( Stack, VariableValue, 0); /* it's a value variable */
                 }
                 else /* push a dummy value */
-                    ExpressionPushInt( &StackTop, 0);
+                    ExpressionPushInt( Stack, 0);
                     
             }
 
@@ -1388,7 +1400,7 @@ int ParseState::ExpressionParse(struct Value **Result)
                 Parser->ProgramFail( "value not expected here");
                 
             PrefixState = FALSE;
-            ExpressionStackPushValue(/*Parser,*/ &StackTop, LexValue);
+            ExpressionStackPushValue(/*Parser,*/ Stack, LexValue);
         }
         else if (IsTypeToken(/*Parser,*/ Token, LexValue))
         {
@@ -1403,9 +1415,9 @@ int ParseState::ExpressionParse(struct Value **Result)
             PrefixState = FALSE;
             ParserCopy(Parser, &PreState);
             Parser->TypeParse( &Typ, &Identifier, NULL);
-			TypeValue = VariableAllocValueFromType( &Parser->pc->TypeType, FALSE, NULL, LocationOnStack);
+			TypeValue = VariableAllocValueFromTypeUncleared( &Parser->pc->TypeType, FALSE, NULL);
             TypeValue->setVal<struct ValueType*>(pc, Typ);
-            ExpressionStackPushValueNode(/*Parser,*/ &StackTop, TypeValue);
+            ExpressionStackPushValueNode(/*Parser,*/ Stack, TypeValue);
         }
         else
         { 
@@ -1421,35 +1433,29 @@ int ParseState::ExpressionParse(struct Value **Result)
         Parser->ProgramFail( "brackets not closed");
         
     /* scan and collapse the stack to precedence 0 */
-    ExpressionStackCollapse(/*Parser,*/ &StackTop, 0, &IgnorePrecedence);
+    ExpressionStackCollapse(/*Parser,*/ Stack, 0, &IgnorePrecedence);
     
-    /* fix up the stack and return the result if we're in run mode */
-    if (StackTop != NULL)
+    /* return the result if we're in run mode. the values stay allocated until the caller resets its mark */
+    StackTop = Stack->Top();
+    if (StackTop != NULL && Parser->Mode == RunModeRun)
     {
         /* all that should be left is a single value on the stack */
-        if (Parser->Mode == RunModeRun)
-        {
-            if (StackTop->Order != OrderNone || StackTop->Next != NULL)
-                Parser->ProgramFail( "invalid expression");
-                
-            *Result = StackTop->ExprVal;
-			Parser->pc->HeapPopStack( StackTop, sizeof(struct ExpressionStack));
-        }
-        else
-			Parser->pc->HeapPopStack(StackTop->ExprVal, sizeof(struct ExpressionStack) + 
-			sizeof(struct Value) + StackTop->ExprVal->TypeStackSizeValue());
+        if (StackTop->Order != OrderNone || Stack->Below(StackTop) != NULL)
+            Parser->ProgramFail( "invalid expression");
+            
+        *Result = StackTop->ExprVal;
     }
     
     debugf("ExpressionParse() done\n\n");
 #ifdef DEBUG_EXPRESSIONS
-    ExpressionStackShow(Parser->pc, StackTop);
+    ExpressionStackShow(Parser->pc, Stack);
 #endif
     return StackTop != NULL;
 }
 
 
 /* do a parameterised macro call */
-void ParseState::ExpressionParseMacroCall(struct ExpressionStack **StackTop, const char *MacroName, StructMacroDef *MDef)
+void ParseState::ExpressionParseMacroCall(struct ExpressionStack *Stack, const char *MacroName, StructMacroDef *MDef)
 {
 	struct ParseState *Parser = this;
     struct Value *ReturnValue = NULL;
@@ -1462,18 +1468,18 @@ void ParseState::ExpressionParseMacroCall(struct ExpressionStack **StackTop, con
     { 
         /* create a stack frame for this macro */
 #ifndef NO_FP
-        ExpressionStackPushValueByType(/*Parser,*/ StackTop, &Parser->pc->FPType);  /* largest return type there is */
+        ExpressionStackPushValueByType(/*Parser,*/ Stack, &Parser->pc->FPType);  /* largest return type there is */
 #else
-        ExpressionStackPushValueByType(/*Parser,*/ StackTop, &Parser->pc->IntType);  /* largest return type there is */
+        ExpressionStackPushValueByType(/*Parser,*/ Stack, &Parser->pc->IntType);  /* largest return type there is */
 #endif
-        ReturnValue = (*StackTop)->ExprVal;
+        ReturnValue = Stack->Top()->ExprVal;
 		Parser->pc->HeapPushStackFrame();
-		ParamArray = static_cast<struct Value**>(Parser->pc->HeapAllocStack( sizeof(struct Value *) * MDef->NumParams));
+		ParamArray = static_cast<struct Value**>(Parser->pc->HeapAllocStackUncleared( sizeof(struct Value *) * MDef->NumParams));
         if (ParamArray == NULL)
-            Parser->ProgramFail( "out of memory");
+            Parser->ProgramFailStack();
     }
     else
-        ExpressionPushInt(/*Parser,*/ StackTop, 0);
+        ExpressionPushInt(/*Parser,*/ Stack, 0);
         
     /* parse arguments */
     ArgCount = 0;
@@ -1532,51 +1538,107 @@ void ParseState::ExpressionParseMacroCall(struct ExpressionStack **StackTop, con
 }
 
 /* do a function call */
-void ParseState::ExpressionParseFunctionCall(struct ExpressionStack **StackTop, const char *FuncName, bool RunIt)
+void ParseState::ExpressionParseFunctionCall(struct ExpressionStack *Stack, const char *FuncName, bool RunIt)
 {
 	struct ParseState *Parser = this;
     struct Value *ReturnValue = NULL;
     struct ValueAbs *FuncValue = NULL;
     struct Value *Param;
     struct Value **ParamArray = NULL;
+    struct Value *ParamValue = NULL;
+    struct Value *ReturnSlot;
+    std::shared_ptr<struct FrameLayout> Layout;
+    struct Value *SlotValues = NULL;
+    char *SlotData = NULL;
+    int NumSlots = 0;
     int ArgCount;
+    struct StackMark ArgMark;
+    const unsigned char *CallSite = Parser->Pos;
     enum LexToken Token = Parser->LexGetToken( NULL, TRUE);    /* open bracket */
     enum RunMode OldMode = Parser->Mode;
     
     if (RunIt)
     { 
         /* get the function definition */
-		VariableGet(  FuncName, &FuncValue);
+        FuncValue = static_cast<struct ValueAbs *>(VariableLookup(CallSite, FuncName));
+        if (FuncValue == NULL)
+			VariableGet(  FuncName, &FuncValue);
         
         if (FuncValue->TypeOfValue->Base == TypeMacro)
         {
             /* this is actually a macro, not a function */
-            ExpressionParseMacroCall(/*Parser,*/ StackTop, FuncName, &FuncValue->ValMacroDef(pc));
+            ExpressionParseMacroCall(/*Parser,*/ Stack, FuncName, &FuncValue->ValMacroDef(pc));
             return;
         }
         
         if (FuncValue->TypeOfValue->Base != TypeFunction)
             Parser->ProgramFail( "%t is not a function - can't call", FuncValue->TypeOfValue);
     
-        ExpressionStackPushValueByType(/*Parser,*/ StackTop, FuncValue->ValFuncDef(pc).ReturnType);
-        ReturnValue = (*StackTop)->ExprVal;
+        /* a struct returned straight from a return statement is written directly into that statement's slot. 
+         * the first call returning the slot's type takes it - calls returning anything else leave it be */
+        ReturnSlot = Parser->pc->ReturnSlot;
+        if (ReturnSlot != nullptr && Parser->pc->TopStackFrame() != nullptr && ReturnSlot == Parser->pc->TopStackFrame()->ReturnValue &&
+			ReturnSlot->TypeOfValue == FuncValue->ValFuncDef(pc).ReturnType && 
+			(ReturnSlot->TypeOfValue->Base == TypeStruct || ReturnSlot->TypeOfValue->Base == TypeUnion))
+        {
+            Parser->pc->ReturnSlot = nullptr;
+            ReturnValue = VariableAllocValueFromExistingData(ReturnSlot->TypeOfValue, 
+				ReturnSlot->isAbsolute ? ReturnSlot->getValAbsolute() : ReturnSlot->getValVirtual(), FALSE, NULL, ReturnSlot->isAbsolute);
+            ExpressionStackPushValueNode(/*Parser,*/ Stack, ReturnValue);
+        }
+        else
+        {
+            ExpressionStackPushValueByType(/*Parser,*/ Stack, FuncValue->ValFuncDef(pc).ReturnType);
+            ReturnValue = Stack->Top()->ExprVal;
+        }
 		Parser->pc->HeapPushStackFrame();
-		ParamArray = static_cast<struct Value**>(Parser->pc->HeapAllocStack( sizeof(struct Value *) * FuncValue->ValFuncDef(pc).NumParams));
-        if (ParamArray == NULL)
-            Parser->ProgramFail( "out of memory");
+        if (FuncValue->ValFuncDef(pc).Intrinsic == nullptr)
+        {
+            /* allocate the parameters and all the locals we know of in one frame block. the parameters are 
+             * found through their slots so there's no parameter array */
+            Layout = VariableFrameLayout(FuncValue);
+            NumSlots = (int)Layout->Slots.size();
+            SlotValues = static_cast<struct Value *>(Parser->pc->HeapAllocStack( MEM_ALIGN(sizeof(struct Value)) * NumSlots));
+            SlotData = static_cast<char *>(Parser->pc->HeapAllocStackVirtual( Layout->Size));
+            if (SlotValues == NULL || SlotData == NULL)
+                Parser->ProgramFailStack();
+        }
+        else
+        {
+            ParamArray = static_cast<struct Value**>(Parser->pc->HeapAllocStackUncleared( sizeof(struct Value *) * FuncValue->ValFuncDef(pc).NumParams));
+            if (ParamArray == NULL)
+                Parser->ProgramFailStack();
+        }
     }
     else
     {
-        ExpressionPushInt(/*Parser,*/ StackTop, 0);
+        ExpressionPushInt(/*Parser,*/ Stack, 0);
         Parser->Mode = RunModeSkip;
     }
         
     /* parse arguments */
     ArgCount = 0;
     do {
+        /* arguments to user-defined functions are evaluated straight into their parameter's frame slot */
         if (RunIt && ArgCount < FuncValue->ValFuncDef(pc).NumParams)
-			ParamArray[ArgCount] = VariableAllocValueFromType(FuncValue->ValFuncDef(pc).ParamType[ArgCount], FALSE, NULL, LocationOnStack);
+        {
+            if (FuncValue->ValFuncDef(pc).Intrinsic == nullptr)
+            {
+                /* parameters are writable and never go out of scope */
+                ParamValue = VariableSlotValue(SlotValues, SlotData, Layout.get(), ArgCount);
+                ParamValue->IsLValue = TRUE;
+                ParamValue->ScopeID = -1;
+            }
+            else
+            {
+				ParamValue = VariableAllocValueFromTypeUncleared(FuncValue->ValFuncDef(pc).ParamType[ArgCount], FALSE, NULL);
+                ParamArray[ArgCount] = ParamValue;
+            }
+        }
         
+        /* the argument's temporaries go as soon as it's evaluated. intrinsics find their arguments
+         * one after another on the stack, so that's where the next one has to start */
+        ArgMark = Parser->pc->HeapMarkStack();
         if (Parser->ExpressionParse( &Param))
         {
             if (RunIt)
@@ -1587,13 +1649,16 @@ void ParseState::ExpressionParseFunctionCall(struct ExpressionStack **StackTop,
 						Param;
 					}
 					assert(Param->getValAbsolute() || Param->getValVirtual());
-                    Parser->ExpressionAssign( ParamArray[ArgCount], Param, TRUE, FuncName, ArgCount+1, FALSE);
-                    Parser->VariableStackPop( Param);
+                    Parser->ExpressionAssign( ParamValue, Param, TRUE, FuncName, ArgCount+1, FALSE);
+                    Parser->pc->HeapResetStack(ArgMark);
                 }
                 else
                 {
                     if (!FuncValue->ValFuncDef(pc).VarArgs)
                         Parser->ProgramFail( "too many arguments to %s()", FuncName);
+
+                    /* keep just the value, straight after the previous argument */
+                    VariableStackKeep(Param, ArgMark);
                 }
             }
             
@@ -1622,8 +1687,6 @@ void ParseState::ExpressionParseFunctionCall(struct ExpressionStack **StackTop,
         { 
             /* run a user-defined function */
             struct ParseState FuncParser;
-            int Count;
-            int OldScopeID = Parser->ScopeID;
             
             if (FuncValue->ValFuncDef(pc).Body.Pos == NULL)
                 Parser->ProgramFail( "'%s' is undefined", FuncName);
@@ -1632,14 +1695,10 @@ void ParseState::ExpressionParseFunctionCall(struct ExpressionStack **StackTop,
             VariableStackFrameAdd(/*Parser,*/ FuncName, FuncValue->ValFuncDef(pc).Intrinsic ? FuncValue->ValFuncDef(pc).NumParams : 0);
             Parser->pc->TopStackFrame()->NumParams = ArgCount;
             Parser->pc->TopStackFrame()->ReturnValue = ReturnValue;
-
-            /* Function parameters should not go out of scope */
-            Parser->ScopeID = -1;
-
-            for (Count = 0; Count < FuncValue->ValFuncDef(pc).NumParams; Count++)
-				VariableDefine(FuncValue->ValFuncDef(pc).ParamName[Count], ParamArray[Count], NULL, TRUE);
-
-            Parser->ScopeID = OldScopeID;
+            Parser->pc->TopStackFrame()->Layout = Layout;
+            Parser->pc->TopStackFrame()->SlotValues = SlotValues;
+            Parser->pc->TopStackFrame()->SlotData = SlotData;
+            Parser->pc->TopStackFrame()->NumSlots = NumSlots;    /* the layout may have grown since, from a call in the arguments */
                 
 			if (FuncParser.ParseStatement(TRUE) != ParseResultOk)
 				FuncParser.ProgramFail("function body expected");
@@ -1670,6 +1729,7 @@ long ParseState::ExpressionParseInt()
 	struct ParseState *Parser = this;
     struct Value *Val;
     long Result = 0;
+    struct StackMark Mark = Parser->pc->HeapMarkStack();
     
 	if (!Parser->ExpressionParse(&Val))
         Parser->ProgramFail( "expression expected");
@@ -1680,9 +1740,43 @@ long ParseState::ExpressionParseInt()
             Parser->ProgramFail( "integer value expected instead of %t", Val->TypeOfValue);
     
 		Result = Val->ExpressionCoerceInteger(pc);
-		Parser->VariableStackPop(Val);
     }
     
+    Parser->pc->HeapResetStack(Mark);
     return Result;
 }
 
+/* parse a condition for if, while, do and for, and reduce it straight to true or false */
+bool ParseState::ExpressionParseCondition()
+{
+	struct ParseState *Parser = this;
+    struct Value *Val;
+    bool Result = false;
+    struct StackMark Mark = Parser->pc->HeapMarkStack();
+    
+	if (!Parser->ExpressionParse(&Val))
+        Parser->ProgramFail( "expression expected");
+    
+    if (Parser->Mode == RunModeRun)
+    { 
+        switch (Val->TypeOfValue->Base)
+        {
+            case TypeInt:             Result = Val->getVal<int>(pc) != 0; break;
+            case TypeChar:            Result = Val->getVal<char>(pc) != 0; break;
+            case TypeShort:           Result = Val->getVal<short>(pc) != 0; break;
+            case TypeLong:            Result = Val->getVal<long>(pc) != 0; break;
+            case TypeUnsignedInt:     Result = Val->getVal<unsigned int>(pc) != 0; break;
+            case TypeUnsignedShort:   Result = Val->getVal<unsigned short>(pc) != 0; break;
+            case TypeUnsignedLong:    Result = Val->getVal<unsigned long>(pc) != 0; break;
+            case TypeUnsignedChar:    Result = Val->getVal<unsigned char>(pc) != 0; break;
+            case TypePointer:         Result = Val->getVal<PointerType>(pc) != nullptr; break;
+#ifndef NO_FP
+            case TypeFP:              Result = Val->getVal<double>(pc) != 0.0; break;
+#endif
+            default:                  Parser->ProgramFail( "integer value expected instead of %t", Val->TypeOfValue);
+        }
+    }
+    
+    Parser->pc->HeapResetStack(Mark);
+    return Result;
+}
@@ -4,6 +4,90 @@
  
 /* stack grows up from the bottom and heap grows down from the top of heap space */
 #include "interpreter.h"
+#include <new>
+
+#ifdef USE_MMAP_STACK
+# ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+# else
+#  include <sys/mman.h>
+# endif
+
+/* stacks are committed in steps of this, and each has this much never-committed guard space past its limit.
+ * it's a multiple of the page size on everything we run on */
+#define STACK_COMMIT_STEP (64*1024)
+#define STACK_ROUND_UP(Size) (((Size) + STACK_COMMIT_STEP - 1) & ~(size_t)(STACK_COMMIT_STEP - 1))
+#endif
+
+/* transparent huge pages come in units of this */
+#define HUGE_PAGE_SIZE (2*1024*1024)
+#define HUGE_PAGE_ROUND_UP(Size) (((Size) + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1))
+
+#ifdef USE_MMAP_STACK
+/* reserve address space for a stack of up to Limit bytes and its guard, committing none of it. 
+ * if Align is set the stack starts on an Align boundary */
+static unsigned char *HeapStackReserve(size_t Limit, size_t Align)
+{
+# ifdef _WIN32
+    return static_cast<unsigned char *>(VirtualAlloc(NULL, Limit + STACK_COMMIT_STEP, MEM_RESERVE, PAGE_NOACCESS));
+# else
+    void *Base = mmap(NULL, Limit + STACK_COMMIT_STEP + Align, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (Base == MAP_FAILED)
+        return NULL;
+    
+    if (Align != 0)
+    {
+        /* trim the reservation down to an aligned one */
+        uintptr_t Start = ((uintptr_t)Base + Align - 1) & ~(uintptr_t)(Align - 1);
+        
+        if (Start > (uintptr_t)Base)
+            munmap(Base, Start - (uintptr_t)Base);
+        munmap((void *)(Start + Limit + STACK_COMMIT_STEP), (uintptr_t)Base + Align - Start);
+        Base = (void *)Start;
+    }
+    
+    return static_cast<unsigned char *>(Base);
+# endif
+}
+
+/* make bytes From to To of a reserved stack usable. pages don't take any memory until they're touched */
+static bool HeapStackCommit(unsigned char *Base, size_t From, size_t To)
+{
+# ifdef _WIN32
+    return VirtualAlloc(Base + From, To - From, MEM_COMMIT, PAGE_READWRITE) != NULL;
+# else
+    return mprotect(Base + From, To - From, PROT_READ | PROT_WRITE) == 0;
+# endif
+}
+
+/* give a reserved stack's address space back */
+static void HeapStackRelease(unsigned char *Base, size_t Limit)
+{
+    if (Base == NULL)
+        return;
+    
+# ifdef _WIN32
+    VirtualFree(Base, 0, MEM_RELEASE);
+# else
+    munmap(Base, Limit + STACK_COMMIT_STEP);
+# endif
+}
+#endif
+
+/* ask for transparent huge pages over whatever whole huge pages a block covers. it's only advice, so 
+ * it quietly does nothing where they aren't available */
+static void HeapAdviseHugePages(void *Mem, size_t Size)
+{
+#if defined(USE_MMAP_STACK) && defined(MADV_HUGEPAGE)
+    uintptr_t Start = ((uintptr_t)Mem + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    uintptr_t End = ((uintptr_t)Mem + Size) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    
+    if (End > Start)
+        madvise((void *)Start, End - Start, MADV_HUGEPAGE);
+#endif
+}
 
 #ifdef DEBUG_HEAP
 void Picoc::ShowBigList()
@@ -25,11 +109,55 @@ void Picoc::HeapInit( int StackOrHeapSize)
 	Picoc *pc = this;
     int AlignOffset = 0;
 	int AlignOffsetVirtual = 0;
+
+    /* scripts can reach what's kept for them, but not the pools of Values, tokens and types 
+     * or the stack the Values are on */
+    pc->ScriptMem.ScriptUseHugePages(pc->HugePages);
+    pc->ScriptMem.ScriptSetSpace(&pc->Space);
+    pc->DataMem.ScriptUseHugePages(pc->HugePages);
+    pc->DataMem.ScriptSetSpace(&pc->Space);
 #ifdef USE_MALLOC_STACK
+# ifdef USE_MMAP_STACK
+    /* reserve room for each stack to grow to its limit but only commit the first step. 
+     * everything past the committed part faults if it's touched. by default the limit is the 
+     * initial size - deeper interpreted recursion needs a bigger native stack too */
+    if (pc->HeapStackLimit < (size_t)StackOrHeapSize)
+        pc->HeapStackLimit = StackOrHeapSize;
+    
+    /* huge pages only cover whole aligned huge pages, so with them the stacks start on a huge page 
+     * boundary, go up in whole huge pages and commit the first one straight away */
+    size_t FirstCommit = STACK_COMMIT_STEP;
+    size_t Align = 0;
+    
+    pc->HeapStackLimit = STACK_ROUND_UP(pc->HeapStackLimit);
+    if (pc->HugePages)
+    {
+        pc->HeapStackLimit = HUGE_PAGE_ROUND_UP(pc->HeapStackLimit);
+        FirstCommit = Align = HUGE_PAGE_SIZE;
+    }
+    
+    pc->HeapMemory = HeapStackReserve(pc->HeapStackLimit, Align);
+    pc->HeapMemoryVirtual = HeapStackReserve(pc->HeapStackLimit, Align);
+    if (pc->HeapMemory == NULL || pc->HeapMemoryVirtual == NULL || 
+            !HeapStackCommit(pc->HeapMemory, 0, FirstCommit) || !HeapStackCommit(pc->HeapMemoryVirtual, 0, FirstCommit))
+        throw std::bad_alloc();
+    
+    pc->HeapStackCommitted = pc->HeapStackCommittedVirtual = FirstCommit;
+    StackOrHeapSize = FirstCommit;
+    pc->Space.SpaceMap(pc->HeapMemoryVirtual, FirstCommit);
+    if (pc->HugePages)
+    {
+        HeapAdviseHugePages(pc->HeapMemory, pc->HeapStackLimit);
+        HeapAdviseHugePages(pc->HeapMemoryVirtual, pc->HeapStackLimit);
+    }
+# else
 	pc->HeapMemory = new unsigned char[StackOrHeapSize]; 
+	pc->HeapMemoryVirtual = new unsigned char[StackOrHeapSize]; 
+	pc->HeapStackCommitted = pc->HeapStackCommittedVirtual = StackOrHeapSize;
+	pc->Space.SpaceMap(pc->HeapMemoryVirtual, StackOrHeapSize);
+# endif
     pc->HeapBottom = nullptr;                     /* the bottom of the (downward-growing) heap */
     pc->HeapStackTop = nullptr;                          /* the top of the stack */
-	pc->HeapMemoryVirtual = new unsigned char[StackOrHeapSize]; 
 	pc->HeapBottomVirtual = nullptr;                     /* the bottom of the (downward-growing) heap */
 	pc->HeapStackTopVirtual = nullptr;                          /* the top of the stack */
 
@@ -61,18 +189,432 @@ void Picoc::HeapInit( int StackOrHeapSize)
 
 }
 
+#ifdef USE_MALLOC_HEAP
+/* each HeapAllocMem() block starts with its size class, or 0 if it's too big for the slab and was malloc()ed, 
+ * then the size that was asked for */
+#define HEAP_SLAB_HEADER MEM_ALIGN(2 * sizeof(int))
+#endif
+
+/* let scripts reach Size bytes from Base. segments never overlap */
+void AddressSpace::SpaceMap(const void *Base, size_t Size)
+{
+    if (Size == 0)
+        return;
+    
+    assert(Segments_.find((uintptr_t)Base) == Segments_.end());
+    Segments_[(uintptr_t)Base] = (uintptr_t)Base + Size;
+}
+
+/* take back a SpaceMap() of the same range */
+void AddressSpace::SpaceUnmap(const void *Base, size_t Size)
+{
+    if (Size == 0)
+        return;
+    
+    assert(Segments_.find((uintptr_t)Base) != Segments_.end() && Segments_[(uintptr_t)Base] == (uintptr_t)Base + Size);
+    Segments_.erase((uintptr_t)Base);
+    SpaceFlush();
+}
+
+/* check a range the cache didn't know about against the segments */
+bool AddressSpace::SpaceWalk(const void *Addr, size_t Size)
+{
+    struct SpaceSegment Found;
+    
+    return SpaceFind((uintptr_t)Addr, &Found) && Size <= Found.End - (uintptr_t)Addr;
+}
+
+/* how many bytes of its segment there are from Addr on, or 0 if it isn't mapped */
+size_t AddressSpace::SpaceExtent(const void *Addr)
+{
+    struct SpaceSegment Found;
+    
+    return SpaceFind((uintptr_t)Addr, &Found) ? Found.End - (uintptr_t)Addr : 0;
+}
+
+/* find the segment an address is in and cache it */
+bool AddressSpace::SpaceFind(uintptr_t Addr, struct SpaceSegment *Found)
+{
+    auto Next = Segments_.upper_bound(Addr);
+    
+    if (Next == Segments_.begin())
+        return false;
+    
+    --Next;
+    if (Addr >= Next->second)
+        return false;
+    
+    Found->Start = Next->first;
+    Found->End = Next->second;
+    Cache_[(Addr >> SPACE_PAGE_SHIFT) % SPACE_CACHE_SIZE] = *Found;
+    return true;
+}
+
+/* forget every cached segment, after something's been unmapped */
+void AddressSpace::SpaceFlush()
+{
+    for (int Entry = 0; Entry < SPACE_CACHE_SIZE; Entry++)
+        Cache_[Entry] = SpaceSegment{ 0, 0 };
+}
+
+/* chunks released on this thread, waiting to be reused */
+struct SpareChunkList
+{
+    std::vector<char *> Chunks;
+    
+    ~SpareChunkList()
+    {
+        for (auto it = Chunks.begin(); it != Chunks.end(); ++it)
+            free(*it);
+    }
+};
+
+static thread_local struct SpareChunkList SpareChunks;
+
+/* get a cleared block of the given size class, or NULL if out of memory */
+void *SizeClassPool::PoolAlloc(int Class)
+{
+    size_t Size = (size_t)Class * POOL_GRANULE;
+    void *NewMem = FreeLists_[Class];
+    
+    if (NewMem != NULL)
+        FreeLists_[Class] = *(void **)NewMem;
+    else
+    {
+        if (Size > ChunkLeft_)
+        {
+            char *NewChunk;
+            
+            if (!SpareChunks.Chunks.empty())
+            {
+                NewChunk = SpareChunks.Chunks.back();
+                SpareChunks.Chunks.pop_back();
+            }
+            else if ((NewChunk = static_cast<char *>(malloc(POOL_CHUNK_SIZE))) == NULL)
+                return NULL;
+            
+            if (Space_ != NULL)
+            {
+                /* a spare chunk may have been some other pool's, so don't let scripts see what's left in it */
+                memset(NewChunk, '\0', POOL_CHUNK_SIZE);
+                Space_->SpaceMap(NewChunk, POOL_CHUNK_SIZE);
+            }
+            
+            Chunks_.push_back(NewChunk);
+            ChunkPos_ = NewChunk;
+            ChunkLeft_ = POOL_CHUNK_SIZE;
+        }
+        
+        NewMem = ChunkPos_;
+        ChunkPos_ += Size;
+        ChunkLeft_ -= Size;
+    }
+    
+    memset(NewMem, '\0', Size);
+    return NewMem;
+}
+
+/* put a block back on its class's free list */
+void SizeClassPool::PoolFree(void *Mem, int Class)
+{
+    *(void **)Mem = FreeLists_[Class];
+    FreeLists_[Class] = Mem;
+}
+
+/* release every block at once */
+void SizeClassPool::PoolRelease()
+{
+    for (auto it = Chunks_.begin(); it != Chunks_.end(); ++it)
+    {
+        if (Space_ != NULL)
+            Space_->SpaceUnmap(*it, POOL_CHUNK_SIZE);
+        
+        if (SpareChunks.Chunks.size() < POOL_SPARE_CHUNKS)
+            SpareChunks.Chunks.push_back(*it);
+        else
+            free(*it);
+    }
+    
+    Chunks_.clear();
+    ChunkPos_ = NULL;
+    ChunkLeft_ = 0;
+    for (int Class = 0; Class <= POOL_CLASSES; Class++)
+        FreeLists_[Class] = NULL;
+}
+
+/* get a cleared small block of the given size class, or NULL if out of memory */
+void *ScriptHeap::ScriptAllocClass(int Class)
+{
+    void *NewMem;
+    
+    if (FreeBlocks_[Class].empty())
+        return Pool_.PoolAlloc(Class);
+    
+    NewMem = FreeBlocks_[Class].back();
+    FreeBlocks_[Class].pop_back();
+    memset(NewMem, '\0', (size_t)Class * POOL_GRANULE);
+    return NewMem;
+}
+
+/* get a cleared block for a script, or NULL if out of memory */
+void *ScriptHeap::ScriptAlloc(size_t Size)
+{
+    int Class = (Size > POOL_GRANULE * POOL_CLASSES) ? 0 : SizeClassPool::PoolClass(Size > 0 ? (int)Size : 1);
+    void *NewMem = Class != 0 ? ScriptAllocClass(Class) : calloc(Size, 1);
+    
+    if (NewMem == NULL)
+        return NULL;
+    
+    if (HugePages_ && Size >= HUGE_PAGE_SIZE)
+        HeapAdviseHugePages(NewMem, Size);
+    
+    if (Class == 0 && Space_ != NULL)
+        Space_->SpaceMap(NewMem, Size);
+    
+    Blocks_[NewMem] = ScriptBlock{ Size, Class };
+    BytesInUse_ += Size;
+    if (BytesInUse_ > PeakBytes_)
+        PeakBytes_ = BytesInUse_;
+    
+    AllocCount_++;
+    return NewMem;
+}
+
+/* resize a script's block, in place if it still fits. NULL if out of memory, in which case the 
+ * old block is untouched. Mem must be NULL or one of our blocks */
+void *ScriptHeap::ScriptRealloc(void *Mem, size_t Size)
+{
+    struct ScriptBlock *Block;
+    void *NewMem;
+    
+    if (Mem == NULL)
+        return ScriptAlloc(Size);
+    
+    Block = &Blocks_.at(Mem);
+    if (Block->Class != 0 && Size <= (size_t)Block->Class * POOL_GRANULE)
+    {
+        /* the size class has room */
+        BytesInUse_ = BytesInUse_ - Block->Size + Size;
+        Block->Size = Size;
+    }
+    else if (Block->Class == 0 && Size > POOL_GRANULE * POOL_CLASSES)
+    {
+        /* big stays big - let the system grow it where it is if it can. it's unmapped while it 
+         * might be moving, since the old range isn't ours once realloc() has it */
+        size_t OldSize = Block->Size;
+        
+        Blocks_.erase(Mem);
+        if (Space_ != NULL)
+            Space_->SpaceUnmap(Mem, OldSize);
+        
+        NewMem = realloc(Mem, Size);
+        if (NewMem == NULL)
+        {
+            if (Space_ != NULL)
+                Space_->SpaceMap(Mem, OldSize);
+            
+            Blocks_[Mem] = ScriptBlock{ OldSize, 0 };
+            return NULL;
+        }
+        
+        if (Space_ != NULL)
+            Space_->SpaceMap(NewMem, Size);
+        
+        if (HugePages_ && Size >= HUGE_PAGE_SIZE)
+            HeapAdviseHugePages(NewMem, Size);
+        
+        Blocks_[NewMem] = ScriptBlock{ Size, 0 };
+        BytesInUse_ = BytesInUse_ - OldSize + Size;
+        Mem = NewMem;
+    }
+    else
+    {
+        /* moving between the size classes and the system */
+        size_t OldSize = Block->Size;
+        
+        if ((NewMem = ScriptAlloc(Size)) == NULL)
+            return NULL;
+        
+        memcpy(NewMem, Mem, Size < OldSize ? Size : OldSize);
+        ScriptFree(Mem);
+        return NewMem;
+    }
+    
+    if (BytesInUse_ > PeakBytes_)
+        PeakBytes_ = BytesInUse_;
+    
+    return Mem;
+}
+
+/* give a script's block back. anything that isn't a live block is ignored */
+void ScriptHeap::ScriptFree(void *Mem)
+{
+    auto Found = Blocks_.find(Mem);
+    
+    if (Found == Blocks_.end())
+        return;
+    
+    BytesInUse_ -= Found->second.Size;
+    if (Found->second.Class != 0)
+        FreeBlocks_[Found->second.Class].push_back(Mem);
+    else
+    {
+        if (Space_ != NULL)
+            Space_->SpaceUnmap(Mem, Found->second.Size);
+        
+        free(Mem);
+    }
+    
+    Blocks_.erase(Found);
+}
+
+/* the size a script asked for for one of its blocks, or 0 for NULL */
+size_t ScriptHeap::ScriptSize(void *Mem) const
+{
+    auto Found = Blocks_.find(Mem);
+    
+    return Found != Blocks_.end() ? Found->second.Size : 0;
+}
+
+/* call Func on every live block with the size that was asked for */
+void ScriptHeap::ScriptForEach(const std::function<void(void *, size_t)> &Func) const
+{
+    for (auto it = Blocks_.begin(); it != Blocks_.end(); ++it)
+        Func(it->first, it->second.Size);
+}
+
+/* free everything the script has, whether it freed it or not */
+void ScriptHeap::ScriptRelease()
+{
+    for (auto it = Blocks_.begin(); it != Blocks_.end(); ++it)
+    {
+        if (it->second.Class != 0)
+            continue;
+        
+        if (Space_ != NULL)
+            Space_->SpaceUnmap(it->first, it->second.Size);
+        
+        free(it->first);
+    }
+    
+    Blocks_.clear();
+    for (int Class = 0; Class <= POOL_CLASSES; Class++)
+        FreeBlocks_[Class].clear();
+    
+    Pool_.PoolRelease();
+    BytesInUse_ = 0;
+}
+
 void Picoc::HeapCleanup()
 {
 	Picoc *pc = this;
+	pc->ScriptMem.ScriptRelease();
+	pc->DataMem.ScriptRelease();
+#ifdef USE_MALLOC_HEAP
+	pc->HeapSlab.PoolRelease();
+#endif
 #ifdef USE_MALLOC_STACK
+	pc->Space.SpaceUnmap(pc->HeapMemoryVirtual, pc->HeapStackCommittedVirtual);
+# ifdef USE_MMAP_STACK
+	HeapStackRelease(pc->HeapMemoryVirtual, pc->HeapStackLimit);
+	HeapStackRelease(pc->HeapMemory, pc->HeapStackLimit);
+# else
 	delete[] pc->HeapMemoryVirtual; 
 	delete[] pc->HeapMemory; 
+# endif
+	pc->HeapMemoryVirtual = nullptr;
+	pc->HeapMemory = nullptr;
+#endif
+}
+
+/* commit more of a stack so it reaches NewTop. returns false if that would take it past its limit 
+ * or its quota - HeapStackOverQuota says which */
+bool Picoc::HeapStackGrow(void *NewTop, bool Virtual)
+{
+#ifdef USE_MALLOC_STACK
+	Picoc *pc = this;
+	unsigned char *Base = Virtual ? pc->HeapMemoryVirtual : pc->HeapMemory;
+    
+	pc->HeapStackOverQuota = pc->Quota.StackBytes != 0 && (size_t)((unsigned char *)NewTop - Base) > pc->Quota.StackBytes;
+	if (pc->HeapStackOverQuota)
+		return false;
+#endif
+#ifdef USE_MMAP_STACK
+	size_t &Committed = Virtual ? pc->HeapStackCommittedVirtual : pc->HeapStackCommitted;
+	size_t Needed = STACK_ROUND_UP((size_t)((unsigned char *)NewTop - Base) + sizeof(ALIGN_TYPE));
+	size_t NewCommitted = Committed * 2;
+    
+	if (Needed > pc->HeapStackLimit)
+		return false;
+    
+	/* at least double it so a deep recursion doesn't commit a step at a time */
+	if (NewCommitted < Needed)
+		NewCommitted = Needed;
+	if (NewCommitted > pc->HeapStackLimit)
+		NewCommitted = pc->HeapStackLimit;
+	if (!HeapStackCommit(Base, Committed, NewCommitted))
+		return false;
+    
+	if (Virtual)
+	{
+		/* it's one segment, so an access can't fail for straddling where it grew */
+		pc->Space.SpaceUnmap(Base, Committed);
+		pc->Space.SpaceMap(Base, NewCommitted);
+	}
+    
+	Committed = NewCommitted;
+	HeapStackSetBottom(Virtual);
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef USE_MALLOC_STACK
+/* a stack's allocations stop at the end of what's committed, or at the quota if that comes first.
+ * going past either takes HeapStackGrow() */
+void Picoc::HeapStackSetBottom(bool Virtual)
+{
+	Picoc *pc = this;
+	unsigned char *Base = Virtual ? pc->HeapMemoryVirtual : pc->HeapMemory;
+	size_t Usable = Virtual ? pc->HeapStackCommittedVirtual : pc->HeapStackCommitted;
+    
+	if (pc->Quota.StackBytes != 0 && pc->Quota.StackBytes < Usable)
+		Usable = pc->Quota.StackBytes;
+    
+	if (Virtual)
+		pc->HeapBottomVirtual = Base + Usable - sizeof(ALIGN_TYPE);
+	else
+		pc->HeapBottom = Base + Usable - sizeof(ALIGN_TYPE);
+}
+#endif
+
+/* set the instance's memory limits. anything already over a new limit fails when it next grows */
+void Picoc::PicocSetQuota(const struct MemoryQuota &NewQuota)
+{
+	Picoc *pc = this;
+	pc->Quota = NewQuota;
+#ifdef USE_MALLOC_STACK
+	HeapStackSetBottom(false);
+	HeapStackSetBottom(true);
 #endif
 }
 
 /* allocate some space on the stack, in the current stack frame
  * clears memory. can return NULL if out of stack space */
 void *Picoc::HeapAllocStack( int Size)
+{
+	void *NewMem = HeapAllocStackUncleared(Size);
+	if (NewMem != NULL)
+		memset(NewMem, '\0', Size);
+    
+    return NewMem;
+}
+
+/* allocate some space on the stack, in the current stack frame, leaving its
+ * contents as they were. for callers which write every byte before reading it.
+ * can return NULL if out of stack space */
+void *Picoc::HeapAllocStackUncleared( int Size)
 {
 	Picoc *pc = this;
 	char *NewMem = static_cast<char*>(pc->HeapStackTop);
@@ -80,11 +622,10 @@ void *Picoc::HeapAllocStack( int Size)
 #ifdef DEBUG_HEAP
     printf("HeapAllocStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size), (unsigned long)pc->HeapStackTop);
 #endif
-    if (NewTop > (char *)pc->HeapBottom)
+    if (NewTop > (char *)pc->HeapBottom && !HeapStackGrow(NewTop, false))
         return NULL;
         
     pc->HeapStackTop = (void *)NewTop;
-    memset((void *)NewMem, '\0', Size);
     return NewMem;
 }
 
@@ -98,7 +639,7 @@ void *Picoc::HeapAllocStackVirtual(int Size)
 #ifdef DEBUG_HEAP
 	printf("HeapAllocStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size), (unsigned long)pc->HeapStackTop);
 #endif
-	if (NewTop > (char *)pc->HeapBottomVirtual)
+	if (NewTop > (char *)pc->HeapBottomVirtual && !HeapStackGrow(NewTop, true))
 		return NULL;
 
 	pc->HeapStackTopVirtual = (void *)NewTop;
@@ -106,16 +647,6 @@ void *Picoc::HeapAllocStackVirtual(int Size)
 	return NewMem;
 }
 
-/* allocate some space on the stack, in the current stack frame */
-void Picoc::HeapUnpopStack( int Size)
-{
-	Picoc *pc=this;
-#ifdef DEBUG_HEAP
-    printf("HeapUnpopStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size), (unsigned long)pc->HeapStackTop);
-#endif
-    pc->HeapStackTop = (void *)((char *)pc->HeapStackTop + MEM_ALIGN(Size));
-}
-
 /* free some space at the top of the stack */
 bool Picoc::HeapPopStack( void *Addr, int Size)
 {
@@ -133,6 +664,30 @@ bool Picoc::HeapPopStack( void *Addr, int Size)
     return true;
 }
 
+/* remember the top of both stacks, so everything allocated after this can be
+ * freed in one go */
+struct StackMark Picoc::HeapMarkStack()
+{
+	Picoc *pc = this;
+	struct StackMark Mark;
+
+	Mark.Top = pc->HeapStackTop;
+	Mark.TopVirtual = pc->HeapStackTopVirtual;
+	return Mark;
+}
+
+/* free everything allocated on the stacks since the mark was taken */
+void Picoc::HeapResetStack(const struct StackMark &Mark)
+{
+	Picoc *pc = this;
+#ifdef DEBUG_HEAP
+    printf("HeapResetStack() back to 0x%lx\n", (unsigned long)Mark.Top);
+#endif
+	assert(Mark.Top <= pc->HeapStackTop && Mark.TopVirtual <= pc->HeapStackTopVirtual);
+	pc->HeapStackTop = Mark.Top;
+	pc->HeapStackTopVirtual = Mark.TopVirtual;
+}
+
 /* push a new stack frame on to the stack */
 void Picoc::HeapPushStackFrame()
 {
@@ -170,24 +725,94 @@ void Picoc::HeapPopStackFrame()
 	}
 }
 
+/* remember where the stacks are, and what the variables there are now hold, for HeapRewind() */
+void Picoc::HeapSeal()
+{
+	Picoc *pc = this;
+	pc->ResetStackFrame = pc->CurrentStackFrame;
+	pc->ResetStackTop = pc->HeapStackTop;
+	pc->ResetStackFrameVirtual = pc->CurrentStackFrameVirtual;
+	pc->ResetStackTopVirtual = pc->HeapStackTopVirtual;
+	
+	pc->ResetDataBlocks.clear();
+	pc->ResetData.clear();
+	pc->DataMem.ScriptForEach([pc](void *Mem, size_t Size) {
+		pc->ResetDataBlocks.emplace_back(Mem, Size);
+		pc->ResetData.insert(pc->ResetData.end(), (char *)Mem, (char *)Mem + Size);
+	});
+}
+
+/* drop everything on the stacks since HeapSeal() and everything the program malloc()ed, and put 
+ * back what the variables from before then held. the stacks stay committed for the next program. 
+ * the tables must have been rewound first, so the data blocks left are the ones there were */
+void Picoc::HeapRewind()
+{
+	Picoc *pc = this;
+	const char *From = pc->ResetData.data();
+	
+	pc->CurrentStackFrame = pc->ResetStackFrame;
+	pc->HeapStackTop = pc->ResetStackTop;
+	pc->CurrentStackFrameVirtual = pc->ResetStackFrameVirtual;
+	pc->HeapStackTopVirtual = pc->ResetStackTopVirtual;
+	pc->ScriptMem.ScriptRelease();
+	
+	for (auto it = pc->ResetDataBlocks.begin(); it != pc->ResetDataBlocks.end(); ++it)
+	{
+		memcpy(it->first, From, it->second);
+		From += it->second;
+	}
+}
+
+/* allocate the storage for a variable on the heap, where the script can reach it. memory is cleared. 
+ * can return NULL if out of memory */
 void *Picoc::HeapAllocVirtualMem(int Size)
 {
 	Picoc *pc = this;
 	void *ret;
-	ret = calloc(Size, 1);
+	
+	pc->HeapQuotaCharge(Size);
+	ret = pc->DataMem.ScriptAlloc(Size);
+	if (ret == NULL)
+		pc->HeapQuotaRelease(Size);
 #ifdef DEBUG_ALLOCATIONS
 	fprintf(stderr, "HeapAllocate value %08x\n", ret);
 #endif
 	return ret;
 }
 
+/* free a variable's storage from HeapAllocVirtualMem() */
+void Picoc::HeapFreeVirtualMem(void *Mem)
+{
+	Picoc *pc = this;
+	
+	pc->HeapQuotaRelease(pc->DataMem.ScriptSize(Mem));
+	pc->DataMem.ScriptFree(Mem);
+}
+
 /* allocate some dynamically allocated memory. memory is cleared. can return NULL if out of memory */
 void *Picoc::HeapAllocMem( int Size)
 {
 	Picoc *pc = this;
 	void *ret;
 #ifdef USE_MALLOC_HEAP
-	 ret=calloc(Size, 1);
+	/* small blocks come from the slab, big ones straight from malloc() */
+	int Class = SizeClassPool::PoolClass(Size + HEAP_SLAB_HEADER);
+	char *NewMem;
+	
+	pc->HeapQuotaCharge(Size);
+	NewMem = static_cast<char *>(Class != 0 ? pc->HeapSlab.PoolAlloc(Class) : calloc(Size + HEAP_SLAB_HEADER, 1));
+	if (NewMem == NULL)
+	{
+		pc->HeapQuotaRelease(Size);
+		return NULL;
+	}
+
+	if (pc->HugePages && Size >= HUGE_PAGE_SIZE)
+		HeapAdviseHugePages(NewMem, Size + HEAP_SLAB_HEADER);
+
+	((int *)NewMem)[0] = Class;
+	((int *)NewMem)[1] = Size;
+	ret = NewMem + HEAP_SLAB_HEADER;
 #ifdef DEBUG_ALLOCATIONS
 	fprintf(stderr,"HeapAllocate value %08x\n",ret);
 #endif
@@ -208,6 +833,8 @@ void *Picoc::HeapAllocMem( int Size)
     if (AllocSize < sizeof(struct AllocNode))
         AllocSize = sizeof(struct AllocNode);
     
+    pc->HeapQuotaCharge(AllocSize);
+    
     Bucket = AllocSize >> 2;
     if (Bucket < FREELIST_BUCKETS && pc->FreeListBucket[Bucket] != NULL)
     { 
@@ -262,7 +889,10 @@ void *Picoc::HeapAllocMem( int Size)
         printf("allocating %d(%d) at bottom of heap (0x%lx-0x%lx)", Size, AllocSize, (long)((char *)pc->HeapBottom - AllocSize), (long)HeapBottom);
 #endif
         if ((char *)pc->HeapBottom - AllocSize < (char *)pc->HeapStackTop)
+        {
+            pc->HeapQuotaRelease(AllocSize);
             return NULL;
+        }
         
         pc->HeapBottom = (void *)((char *)pc->HeapBottom - AllocSize);
         NewMem = pc->HeapBottom;
@@ -278,6 +908,25 @@ void *Picoc::HeapAllocMem( int Size)
 #endif
 }
 
+#ifdef USE_MALLOC_HEAP
+/* give a HeapAllocMem() block back to the slab, or to the system if it was too big for the slab */
+void Picoc::HeapSlabFree(void *Mem)
+{
+	Picoc *pc = this;
+	char *Block;
+
+	if (Mem == NULL)
+		return;
+
+	Block = static_cast<char *>(Mem) - HEAP_SLAB_HEADER;
+	pc->HeapQuotaRelease(((int *)Block)[1]);
+	if (*(int *)Block != 0)
+		pc->HeapSlab.PoolFree(Block, *(int *)Block);
+	else
+		free(Block);
+}
+#endif
+
 /* free some dynamically allocated memory */
 void Picoc::HeapFreeMem( void *Mem)
 {
@@ -286,7 +935,7 @@ void Picoc::HeapFreeMem( void *Mem)
 	fprintf(stderr, "HeapFree value %08x\n", Mem);
 #endif
 #ifdef USE_MALLOC_HEAP
-    free(Mem);
+	HeapSlabFree(Mem);
 #else
     struct AllocNode *MemNode = (struct AllocNode *)((char *)Mem - MEM_ALIGN(sizeof(MemNode->Size)));
     int Bucket = MemNode->Size >> 2;
@@ -299,6 +948,8 @@ void Picoc::HeapFreeMem( void *Mem)
     if (Mem == NULL)
         return;
     
+    pc->HeapQuotaRelease(MemNode->Size);
+    
     if ((void *)MemNode == pc->HeapBottom)
     { 
         /* pop it off the bottom of the heap, reducing the heap size */
@@ -344,7 +995,7 @@ void Picoc::HeapFreeMem(UnionAnyValuePointer Mem)
 	fprintf(stderr, "HeapFree value %08x\n", Mem);
 #endif
 #ifdef USE_MALLOC_HEAP
-	free(Mem);
+	HeapSlabFree(Mem);
 #else
 	struct AllocNode *MemNode = (struct AllocNode *)((char *)Mem - MEM_ALIGN(sizeof(MemNode->Size)));
 	int Bucket = MemNode->Size >> 2;
@@ -357,6 +1008,8 @@ void Picoc::HeapFreeMem(UnionAnyValuePointer Mem)
 	if (Mem == NULL)
 		return;
 
+	pc->HeapQuotaRelease(MemNode->Size);
+
 	if ((void *)MemNode == pc->HeapBottom)
 	{
 		/* pop it off the bottom of the heap, reducing the heap size */
@@ -13,40 +13,43 @@ static void MyAssert_(bool condition){
 #define MyAssert(a) 
 #endif
 
-Value::Value() : TypeOfValue{}, Val_{}, ValAbsolute_{}, LValueFrom{}, ValOnHeap{}, ValOnStack{},
-AnyValOnHeap{}, IsLValue{}, ScopeID{}, OutOfScope{}, isAbsolute{ false }, isAnyValueAllocated{}, valueCreationSource{1}
+Value::Value() : TypeOfValue{}, LValueFrom{}, Data_{}, ScopeID{}, ValOnHeap{}, ValOnStack{},
+AnyValOnHeap{}, IsLValue{}, OutOfScope{}, isAbsolute{ false }, isAnyValueAllocated{}, ValInPool{}, valueCreationSource{1}
 {}
 
+/* the header is meant to stay at four pointers - see "picoc -z" for the current sizes */
+static_assert(sizeof(struct Value) <= 4 * sizeof(void *), "struct Value has grown");
+
 ValueAbs::ValueAbs() : Value(){ isAbsolute = true; valueCreationSource = 2; }
 
 UnionAnyValuePointer Value::getVal_(){
-	return Val_;
+	return Data_;
 }
 void Value::setVal_(UnionAnyValuePointer newVal){
-	Val_ = newVal;
+	Data_ = newVal;
 }
 UnionAnyValuePointer Value::getValAbsolute(){
-	return ValAbsolute_;
+	return isAbsolute ? Data_ : nullptr;
 }
 void Value::setValAbsolute(Picoc *pc, UnionAnyValuePointer newVal){
-	if (isAnyValueAllocated) pc->HeapFreeMem(Val_);
+	if (isAnyValueAllocated && !isAbsolute) pc->HeapFreeVirtualMem(Data_);
+	MyAssert(isAbsolute || Data_ == nullptr);
 	isAnyValueAllocated = false;
 	isAbsolute = true;
-	MyAssert(Val_ == nullptr);
 	MyAssert(newVal != nullptr);
-	ValAbsolute_ = newVal;
+	Data_ = newVal;
 }
 UnionAnyValuePointerVirtual Value::getValVirtual(){
-	return Val_;
+	return isAbsolute ? nullptr : Data_;
 }
 void Value::setValVirtual(Picoc *pc,UnionAnyValuePointerVirtual newVal){
-	if (isAnyValueAllocated) 
-		pc->HeapFreeMem(Val_);
+	if (isAnyValueAllocated && !isAbsolute) 
+		pc->HeapFreeVirtualMem(Data_);
+	MyAssert(!isAbsolute || Data_ == nullptr);
 	isAnyValueAllocated = false;
 	isAbsolute = false;
-	MyAssert(ValAbsolute_==nullptr);
 	MyAssert(newVal != nullptr);
-	Val_ = newVal;
+	Data_ = newVal;
 }
 
 unsigned char &UnionAnyValue::UnsignedCharacter(){
@@ -355,7 +358,7 @@ void ParseState::setTemp(Picoc *newPc){
 TableEntry::TableEntry() :   
 DeclFileName{},       /* where the variable was declared */
 DeclLine{}, DeclColumn{},
-identifier_{}, freeValueEntryVal{0}{
+freeValueEntryVal{0}, Deleted{0}, Hidden{0}{
 	p.b.FileName = nullptr;
 	p.b.Line = 0;
 	p.b.CharacterPos = 0;
@@ -374,9 +377,64 @@ TableEntry::~TableEntry(){
 
 
 Table::Table() :  
-hashTable_{}
+hashTable_{},
+Slots_{},
+Deleted_{},
+ScopeStack_{},
+Bindings_{},
+Sealed_{},
+SealBroken_{}
+{}
+
+StringInterner::StringInterner() :
+Slots_{},
+Count_{},
+Blocks_{},
+BlockPos_{},
+BlockLeft_{},
+SealSlots_{},
+SealCount_{},
+SealBlocks_{},
+SealPos_{},
+SealLeft_{}
+{}
+
+SizeClassPool::SizeClassPool() :
+Space_{},
+Chunks_{},
+ChunkPos_{},
+ChunkLeft_{},
+FreeLists_{}
+{}
+
+AddressSpace::AddressSpace() :
+Segments_{},
+Cache_{}
+{}
+
+SizeClassPool::~SizeClassPool(){
+	PoolRelease();
+}
+
+ScriptHeap::ScriptHeap() :
+Pool_{},
+Space_{},
+Blocks_{},
+FreeBlocks_{},
+BytesInUse_{},
+PeakBytes_{},
+AllocCount_{},
+HugePages_{}
 {}
 
+ScriptHeap::~ScriptHeap(){
+	ScriptRelease();
+}
+
+StringInterner::~StringInterner(){
+	InternerFree();
+}
+
 Table::~Table(){
 	TableFree();
 }
@@ -385,7 +443,12 @@ Table::~Table(){
 StackFrame::StackFrame() : ReturnParser{}, FuncName{}, ReturnValue{},
 Parameter{}, NumParams{},
 LocalTable{ new struct Table }, 
-PreviousStackFrame{}
+PreviousStackFrame{},
+Layout{},
+SlotValues{},
+SlotData{},
+NumSlots{},
+ReallocData{}
 {}
 
 StackFrame::~StackFrame(){
@@ -398,6 +461,11 @@ StackFrame &StackFrame::operator=(StackFrame &in){
 	Parameter = in.Parameter;
 	NumParams = in.NumParams;
 	LocalTable = in.LocalTable;
+	Layout = in.Layout;
+	SlotValues = in.SlotValues;
+	SlotData = in.SlotData;
+	NumSlots = in.NumSlots;
+	ReallocData = in.ReallocData;
 	return *this;
 }
 
@@ -406,7 +474,13 @@ FuncName { in.FuncName},
 ReturnValue { in.ReturnValue},
 Parameter { in.Parameter},
 NumParams {in.NumParams},
-LocalTable { in.LocalTable}
+LocalTable { in.LocalTable},
+PreviousStackFrame { in.PreviousStackFrame},
+Layout { in.Layout},
+SlotValues { in.SlotValues},
+SlotData { in.SlotData},
+NumSlots { in.NumSlots},
+ReallocData { in.ReallocData}
 {
 		ReturnParser= in.ReturnParser ;
 }
@@ -414,7 +488,7 @@ LocalTable { in.LocalTable}
 
 
 
-Picoc_Struct::Picoc_Struct(size_t StackSize) :
+Picoc_Struct::Picoc_Struct(size_t StackSize, size_t StackLimit, bool HugePages) :
 GlobalTable{},
 CleanupTokenList{  },
 /* lexer global data */
@@ -424,7 +498,6 @@ InteractiveCurrentLine{ nullptr },
 LexUseStatementPrompt{},
 LexAnyValue{},
 LexValue{},
-ReservedWordTable{},
 /* the table of string literal values */
 StringLiteralTable{},
 /* the stack */
@@ -445,6 +518,10 @@ HeapMemoryVirtual{},          /* stack memory since our heap is malloc()ed */
 HeapBottomVirtual{},                   /* the bottom of the (downward-growing) heap */
 CurrentStackFrameVirtual{},                   /* the current stack frame */
 HeapStackTopVirtual{},                 /* the top of the stack */
+HeapStackLimit{ StackLimit },
+HeapStackCommitted{},
+HeapStackCommittedVirtual{},
+HeapStackOverQuota{},
 #else
 # ifdef SURVEYOR_HOST
 HeapMemory;          /* all memory - stack and heap */
@@ -459,10 +536,20 @@ CurrentStackFrame;                   /* the current stack frame */
 HeapStackTop;                 /* the top of the stack */
 # endif
 #endif
+Space{},
 #ifndef USE_MALLOC_HEAP
 FreeListBucket(FREELIST_BUCKETS,nullptr),      /* we keep a pool of freelist buckets to reduce fragmentation */
 FreeListBig{},                           /* free memory which doesn't fit in a bucket */
 #endif
+#ifdef USE_MALLOC_HEAP
+HeapSlab{},
+#endif
+ValuePool{},
+ScriptMem{},
+DataMem{},
+Quota{},
+InternalBytes{},
+HugePages{ HugePages },
 /* types */
 UberType{},
 IntType{},
@@ -486,11 +573,23 @@ CharPtrType{},
 CharPtrPtrType{},
 CharArrayType{},
 VoidPtrType{},
+NoMembers{},
+DerivedTypes{},
+TypeFrontCache{},
+TypeIdentCache{},
+TypeCacheEpoch{},
+TypeCacheable{ TRUE },
+VariableCache{},
+ReturnSlot{},
+FrameLayouts{},
+ExpressionStacks{},
+ExpressionDepth{},
 
 /* debugger */
-BreakpointTable{},
+Breakpoints{},
 BreakpointCount{},
 DebugManualBreak{},
+DebugHook{},
 
 /* C library */
 BigEndian{},
@@ -498,9 +597,20 @@ LittleEndian{},
 
 CStdOut{},
 CStdOutBase{},
+TimeBuffer{},
+Streams{},
+StrtokNext{},
 
 /* the picoc version string */
 VersionString{},
+ResetTypes{},
+ResetTokens{},
+ResetStackFrame{},
+ResetStackFrameVirtual{},
+ResetStackTop{},
+ResetStackTopVirtual{},
+ResetDataBlocks{},
+ResetData{},
 PointerAlignBytes{},
 IntAlignBytes{}
 { 
@@ -510,6 +620,19 @@ Picoc_Struct::~Picoc_Struct(){
 	this->PicocCleanup(); 
 }
 
+PicocTemplate::PicocTemplate(size_t StackSize, void (*Prepare)(Picoc *pc), size_t MaxIdle) :
+StackSize_{ StackSize },
+Prepare_{ Prepare },
+MaxIdle_{ MaxIdle },
+Idle_{},
+IdleLock_{}
+{}
+
+PicocTemplate::~PicocTemplate(){
+	for (auto it = Idle_.begin(); it != Idle_.end(); ++it)
+		delete *it;
+}
+
 StructStackFrame *Picoc_Struct::TopStackFrame(){
 	if (topStackFrame_.empty())
 		return nullptr;
@@ -521,6 +644,16 @@ void Picoc_Struct::pushStackFrame(StructStackFrame &newFrame){
 }
 
 void Picoc_Struct::popStackFrame(){
+	std::vector<std::pair<void *, bool>> &ReallocData = topStackFrame_.back().ReallocData;
+	
+	/* the locals that were resized go with the call */
+	for (auto it = ReallocData.begin(); it != ReallocData.end(); ++it)
+	{
+		if (it->second)
+			HeapFreeMem(it->first);
+		else
+			HeapFreeVirtualMem(it->first);
+	}
 	topStackFrame_.resize(topStackFrame_.size()-1);
 }
 
@@ -11,11 +11,19 @@
 
 #include <string>
 #include <list>
+#include <map>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
 // for std::function
+#include <functional>
 #include <thread>
+#include <mutex>
 //for std::shared_ptr
 #include <memory>
+//for uintptr_t
+#include <cstdint>
 
 const size_t  picocStackSize = (1128 * 1024);
 
@@ -67,6 +75,7 @@ typedef FILE IOFILE;
 
 
 struct Table;
+struct MemberList;
 struct Picoc_Struct;
 
 using Picoc = struct Picoc_Struct;
@@ -88,6 +97,15 @@ enum MemoryLocation {
 	LocationOnStack, LocationOnHeap, LocationOnHeapVirtual,LocationOnStackVirtual
 };
 
+/* the evaluation order of an operator on the expression stack */
+enum OperatorOrder
+{
+    OrderNone,
+    OrderPrefix,
+    OrderInfix,
+    OrderPostfix
+};
+
 /* lexical tokens */
 enum LexToken
 {
@@ -161,7 +179,7 @@ public:
     short int HashIfLevel;      /* how many "if"s we're nested down */
     short int HashIfEvaluateToLevel;    /* if we're not evaluating an if branch, what the last evaluated level was */
     char DebugMode;             /* debugging mode */
-    int ScopeID;                /* for keeping track of local variables (free them after they go out of scope) */
+    int ScopeID;                /* scope stack mark of the current block, -1 if definitions aren't scoped */
 public:
 
 	friend void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser);
@@ -185,17 +203,19 @@ public:
 	/* expression.cpp */
 	int ExpressionParse( struct Value **Result);
 	long ExpressionParseInt();
+	bool ExpressionParseCondition();
 	void ExpressionAssign( struct Value *DestValue, struct Value *SourceValue, int Force, const char *FuncName, int ParamNo, int AllowPointerCoercion);
 	/* type.c */
 	int TypeParseFront( struct ValueType **Typ, int *IsStatic);
 	void TypeParseIdentPart( struct ValueType *BasicTyp, struct ValueType **Typ, const char **Identifier);
+	int TypeParseFrontNoCache( struct ValueType **Typ, int *IsStatic);
+	void TypeParseIdentPartNoCache( struct ValueType *BasicTyp, struct ValueType **Typ, const char **Identifier);
 	void TypeParse( struct ValueType **Typ, const char **Identifier, int *IsStatic);
 	int TypeIsForwardDeclared( struct ValueType *Typ);
 
 
 
 	/* variable.c */
-	void VariableStackPop( struct Value *Var);
 	//struct Value *VariableAllocValueFromExistingData( struct ValueType *Typ, UnionAnyValuePointer FromValue, int IsLValue, struct Value *LValueFrom);
 	struct Value *VariableAllocValueFromExistingData(struct ValueType *Typ, UnionAnyValuePointer FromValue, int IsLValue, 
 	struct Value *LValueFrom, bool isAbsoluteFromValue);
@@ -205,21 +225,26 @@ public:
 	struct Value *VariableDefineButIgnoreIdentical( const char *Ident, struct ValueType *Typ, int IsStatic, int *FirstVisit);
 	void VariableRealloc( struct Value *FromValue, int NewSize);
 	void VariableReallocVirtual(struct Value *FromValue, int NewSize);
+	void VariableReallocOwner(struct Value *FromValue, void *NewData, bool isAbsolute);
 	void VariableReallocAbsolute(struct Value *FromValue, int NewSize);
 	void VariableRealloc(struct ValueAbs *FromValue, int NewSize);
 	void VariableStackFrameAdd(const char *FuncName, int NumParams);
 	void VariableStackFramePop();
 	PointerType VariableDereferencePointer( struct Value *PointerValue, struct Value **DerefVal, int *DerefOffset, 
 	struct ValueType **DerefType, int *DerefIsLValue);
+	void VariableCheckPointer(PointerType Addr, struct ValueType *Typ);
+	void VariableCheckRange(const void *Addr, size_t Size);
+	size_t VariableCheckString(const char *Str, size_t MaxLen = (size_t)-1);
 	int VariableScopeBegin(int* PrevScopeID);
 	void VariableScopeEnd( int ScopeID, int PrevScopeID);
 	void ParseState::ProgramFail(const char *Message, ...);
+	void ProgramFailStack();
 	void ParseState::AssignFail(const char *Format, struct ValueType *Type1, struct ValueType *Type2,
 		int Num1, int Num2, const char *FuncName, int ParamNo);
 	void ParseState::DebugCheckStatement();
 
 private:
-	struct TableEntry *ParseState::DebugTableSearchBreakpoint();
+	int ParseState::DebugIsBreakpoint();
 	void ParseState::DebugSetBreakpoint();
 	int ParseState::DebugClearBreakpoint();
 	void TypeParseStruct(struct ValueType **Typ, int IsStruct);
@@ -236,31 +261,32 @@ private:
 		int ParseState::IsTypeToken(enum LexToken t, struct Value * LexValue);
 		long ParseState::ExpressionAssignInt(struct Value *DestValue, long FromInt, int After);
 		double ParseState::ExpressionAssignFP(struct Value *DestValue, double FromFP);
-		void ParseState::ExpressionStackPushValueNode(struct ExpressionStack **StackTop, struct Value *ValueLoc);
-		struct Value *ParseState::ExpressionStackPushValueByType(struct ExpressionStack **StackTop, struct ValueType *PushType);
-		void ParseState::ExpressionStackPushValue(struct ExpressionStack **StackTop, struct Value *PushValue);
-		void ParseState::ExpressionStackPushLValue(struct ExpressionStack **StackTop, struct Value *PushValue, int Offset);
-		void ParseState::ExpressionStackPushDereference(struct ExpressionStack **StackTop, struct Value *DereferenceValue);
-		void ParseState::ExpressionPushInt(struct ExpressionStack **StackTop, long IntValue);
+		void ParseState::ExpressionStackPushValueNode(struct ExpressionStack *Stack, struct Value *ValueLoc);
+		struct Value *ParseState::ExpressionStackPushValueByType(struct ExpressionStack *Stack, struct ValueType *PushType);
+		struct Value *ParseState::ExpressionStackPushValueByTypeUncleared(struct ExpressionStack *Stack, struct ValueType *PushType);
+		void ParseState::ExpressionStackPushValue(struct ExpressionStack *Stack, struct Value *PushValue);
+		void ParseState::ExpressionStackPushLValue(struct ExpressionStack *Stack, struct Value *PushValue, int Offset);
+		void ParseState::ExpressionStackPushDereference(struct ExpressionStack *Stack, struct Value *DereferenceValue);
+		void ParseState::ExpressionPushInt(struct ExpressionStack *Stack, long IntValue);
 #ifndef NO_FP
-		void ParseState::ExpressionPushFP(struct ExpressionStack **StackTop, double FPValue);
+		void ParseState::ExpressionPushFP(struct ExpressionStack *Stack, double FPValue);
 #endif
 			void ParseState::ExpressionAssignToPointer(struct Value *ToValue, struct Value *FromValue,
 			const char *FuncName, int ParamNo, int AllowPointerCoercion);
-			void ParseState::ExpressionQuestionMarkOperator(struct ExpressionStack **StackTop, 
+			void ParseState::ExpressionQuestionMarkOperator(struct ExpressionStack *Stack, 
 			struct Value *BottomValue, struct Value *TopValue);
-			void ParseState::ExpressionColonOperator(struct ExpressionStack **StackTop, 
+			void ParseState::ExpressionColonOperator(struct ExpressionStack *Stack, 
 			struct Value *BottomValue, struct Value *TopValue);
-			void ParseState::ExpressionPrefixOperator(struct ExpressionStack **StackTop, enum LexToken Op, struct Value *TopValue);
-			void ExpressionPostfixOperator(struct ExpressionStack **StackTop, enum LexToken Op, struct Value *TopValue);
-			void ParseState::ExpressionStackCollapse(struct ExpressionStack **StackTop, int Precedence, int *IgnorePrecedence);
-			void ParseState::ExpressionInfixOperator(struct ExpressionStack **StackTop, enum LexToken Op, 
+			void ParseState::ExpressionPrefixOperator(struct ExpressionStack *Stack, enum LexToken Op, struct Value *TopValue);
+			void ExpressionPostfixOperator(struct ExpressionStack *Stack, enum LexToken Op, struct Value *TopValue);
+			void ParseState::ExpressionStackCollapse(struct ExpressionStack *Stack, int Precedence, int *IgnorePrecedence);
+			void ParseState::ExpressionInfixOperator(struct ExpressionStack *Stack, enum LexToken Op, 
 			struct Value *BottomValue, struct Value *TopValue);
-			void ParseState::ExpressionStackPushOperator(struct ExpressionStack **StackTop, enum OperatorOrder Order, 
+			void ParseState::ExpressionStackPushOperator(struct ExpressionStack *Stack, enum OperatorOrder Order, 
 			enum LexToken Token, int Precedence);
-			void ParseState::ExpressionGetStructElement(struct ExpressionStack **StackTop, enum LexToken Token);
-			void ParseState::ExpressionParseMacroCall(struct ExpressionStack **StackTop, const char *MacroName, StructMacroDef *MDef);
-			void ParseState::ExpressionParseFunctionCall(struct ExpressionStack **StackTop, const char *FuncName, bool RunIt);
+			void ParseState::ExpressionGetStructElement(struct ExpressionStack *Stack, enum LexToken Token);
+			void ParseState::ExpressionParseMacroCall(struct ExpressionStack *Stack, const char *MacroName, StructMacroDef *MDef);
+			void ParseState::ExpressionParseFunctionCall(struct ExpressionStack *Stack, const char *FuncName, bool RunIt);
 			enum LexToken ParseState::LexGetRawToken(struct ValueAbs **Value, int IncPos);
 			void ParseState::LexHashIncPos(int IncPos);
 			void ParseState::LexHashIfdef(int IfNot);
@@ -270,15 +296,23 @@ private:
 			void ParseState::TypeParseEnum(struct ValueType **Typ);
 			struct ValueType *ParseState::TypeParseBack(struct ValueType *FromType);
 public:
+			void *VariableAllocPooled( int Class);
 			void *VariableAlloc( int Size, MemoryLocation OnHeap);
 			UnionAnyValuePointer VariableAllocVirtual(int Size, MemoryLocation OnHeap);
 			struct Value *VariableAllocValueAndData( int DataSize, int IsLValue, struct Value *LValueFrom, MemoryLocation OnHeap);
+			struct Value *VariableAllocValueAndDataUncleared( int DataSize, int IsLValue, struct Value *LValueFrom);
 			struct ValueAbs *VariableAllocValueAndDataAbsolute(int DataSize, int IsLValue, struct Value *LValueFrom, MemoryLocation OnHeap);
 			struct Value *VariableAllocValueAndCopy(struct Value *FromValue, MemoryLocation OnHeap);
 			struct Value *VariableAllocValueFromType( struct ValueType *Typ, int IsLValue,
 			struct Value *LValueFrom, MemoryLocation OnHeap);
+			struct Value *VariableAllocValueFromTypeUncleared( struct ValueType *Typ, int IsLValue, struct Value *LValueFrom);
+			struct Value *VariableStackKeep( struct Value *Var, const struct StackMark &Mark);
 			struct Value *VariableDefine( const char *Ident, struct Value *InitValue, struct ValueType *Typ, int MakeWritable);
+			struct Value *VariableDefineInFrame( const char *Ident, struct ValueType *Typ);
+			std::shared_ptr<struct FrameLayout> VariableFrameLayout( struct ValueAbs *FuncValue);
+			struct Value *VariableSlotValue( struct Value *SlotValues, char *SlotData, struct FrameLayout *Layout, int SlotNo);
 			void VariableGet( const char *Ident, struct Value **LVal);
+			struct Value *VariableLookup( const unsigned char *Site, const char *Ident);
 			void VariableGet(const char *Ident, struct ValueAbs **LVal);
 			void VariableDefinePlatformVar(const char *Ident, struct ValueType *Typ,
 				UnionAnyValuePointer FromValue, int IsWritable,size_t Size);
@@ -329,11 +363,149 @@ struct ValueType
     struct ValueType *FromType;     /* the type we're derived from (or NULL) */
     struct ValueType *DerivedTypeList;  /* first in a list of types derived from this one */
     struct ValueType *Next;         /* next item in the derived type list */
-    struct Table *Members;          /* members of a struct or union */
+    struct MemberList *Members;     /* members of a struct or union */
     MemoryLocation OnHeap;                     /* true if allocated on the heap */
     bool StaticQualifier;            /* true if it's a static */
 };
 
+/* a struct or union member */
+struct StructMember
+{
+    const char *Ident;
+    struct ValueType *Typ;
+    int Offset;                     /* from the start of the struct, always 0 for a union */
+};
+
+/* the members of a struct or union in declaration order, with an index sorted by identifier for lookup */
+struct MemberList
+{
+    std::vector<struct StructMember> Members;
+    std::vector<int> ByIdent;       /* member numbers in order of identifier address */
+
+    struct StructMember *MemberFind(const char *Ident);
+    bool MemberAdd(const char *Ident, struct ValueType *Typ, int Offset);
+};
+
+/* an item on the expression stack - either a value or an operator */
+struct ExpressionStackNode
+{
+    struct Value *ExprVal;              /* the value for this stack node, NULL for an operator */
+    enum LexToken Op;                   /* the operator */
+    short unsigned int Precedence;      /* the operator precedence of this node */
+    unsigned char Order;                /* the evaluation order of this operator */
+};
+
+/* the operand and operator stack of one ExpressionParse(). the array is kept
+ * in Picoc::ExpressionStacks and reused by later expressions at the same depth */
+struct ExpressionStack
+{
+    std::vector<struct ExpressionStackNode> Nodes;
+
+    struct ExpressionStackNode *Top() { return Nodes.empty() ? nullptr : &Nodes.back(); }
+    struct ExpressionStackNode *Below(struct ExpressionStackNode *Node) { return Node == Nodes.data() ? nullptr : Node - 1; }
+    void Pop(int Count) { Nodes.resize(Nodes.size() - Count); }
+};
+
+/* what identifies a derived type among its parent's derived types */
+struct DerivedTypeKey
+{
+    struct ValueType *ParentType;
+    enum BaseType Base;
+    int ArraySize;
+    const char *Identifier;
+
+    bool operator==(const DerivedTypeKey &Other) const
+    {
+        return ParentType == Other.ParentType && Base == Other.Base && ArraySize == Other.ArraySize && Identifier == Other.Identifier;
+    }
+};
+
+struct DerivedTypeKeyHash
+{
+    size_t operator()(const DerivedTypeKey &Key) const
+    {
+        size_t Hash = (size_t)(uintptr_t)Key.ParentType;
+        Hash = Hash * 31 + (size_t)Key.Base;
+        Hash = Hash * 31 + (size_t)Key.ArraySize;
+        Hash = Hash * 31 + (size_t)(uintptr_t)Key.Identifier;
+        return Hash ^ (Hash >> 16);
+    }
+};
+
+/* a breakpoint's position */
+struct BreakpointKey
+{
+    const char *FileName;
+    int Line;
+    int CharacterPos;
+
+    bool operator==(const BreakpointKey &Other) const
+    {
+        return FileName == Other.FileName && Line == Other.Line && CharacterPos == Other.CharacterPos;
+    }
+};
+
+/* a type as it was at the reset point, so Reset() can take away whatever was added to it since */
+struct TypeSealEntry
+{
+    struct ValueType *Typ;
+    struct ValueType *DerivedTypeList;  /* the newest derived type then - newer ones are in front of it */
+    struct MemberList *Members;         /* a struct the program completed goes back to being incomplete */
+    int Sizeof;
+    int AlignBytes;
+};
+
+struct BreakpointKeyHash
+{
+    size_t operator()(const BreakpointKey &Key) const
+    {
+        return ((size_t)(uintptr_t)Key.FileName) ^ (((size_t)Key.Line << 16) | (size_t)Key.CharacterPos);
+    }
+};
+
+/* a type parse remembered by the token position it started at, so re-running
+ * the same cast, sizeof or declaration doesn't have to parse it again */
+struct TypeCacheEntry
+{
+    struct ValueType *FromType;     /* the basic type we started from (ident part only) */
+    struct ValueType *Typ;          /* the resulting type */
+    const char *Identifier;         /* the identifier found (ident part only) */
+    int IsStatic;                   /* a static qualifier was present (front only) */
+    const unsigned char *EndPos;    /* where the parse finished */
+    short int LineDelta;            /* newlines crossed during the parse */
+    short int CharacterPos;         /* column at the end of the parse */
+    unsigned int Epoch;             /* TypeCacheEpoch when this was stored */
+};
+
+/* an identifier lookup remembered at the token position it was made from */
+struct VariableCacheEntry
+{
+    const char *Ident;              /* the identifier looked up */
+    struct FrameLayout *Layout;     /* if it resolved to a frame slot or a global binding, the layout it's from */
+    int Slot;                       /* and which slot */
+    struct Value **Cell;            /* if it resolved to a global, the global's binding cell */
+    size_t LocalNames;              /* how many local names the layout had when the global was bound */
+};
+
+/* a local variable or parameter's place in its function's frame block */
+struct FrameSlot
+{
+    const char *Ident;                  /* the name, for error messages and the debugger */
+    struct ValueType *Typ;
+    int Offset;                         /* where its data goes in the frame block */
+};
+
+/* the locals and parameters of a function. parameters come first, then locals in the order 
+ * their declarations were first run. each call allocates all the slots in one block */
+struct FrameLayout
+{
+    std::vector<struct FrameSlot> Slots;
+    std::unordered_map<const unsigned char *, int> SlotOfDecl;  /* slot number by declaration position */
+    int Size;                           /* the size of the frame block */
+    std::unordered_set<const char *> Names;  /* every name the function has defined locally */
+    std::unordered_map<const char *, std::vector<int>> SlotsOfName;  /* slot numbers by name, oldest first */
+};
+
 /* function definition */
 struct Value;
 struct FuncDef__
@@ -458,12 +630,20 @@ public:
 
     struct ValueType *TypeOfValue;          /* the type of this value */
     struct Value *LValueFrom;       /* if an LValue, this is a Value our LValue is contained within (or NULL) */
-    char ValOnHeap;                 /* this Value is on the heap */
-    char ValOnStack;                /* the AnyValue is on the stack along with this Value */
-    char AnyValOnHeap;              /* the AnyValue is separately allocated from the Value on the heap */
-    char IsLValue;                  /* is modifiable and is allocated somewhere we can usefully modify it */
+private:
+	UnionAnyValuePointer Data_;     /* pointer to the AnyValue which holds the actual content, absolute or virtual depending on isAbsolute */
+public:
     int ScopeID;                    /* to know when it goes out of scope */
-    char OutOfScope;
+    /* the flags share one word so the whole header is four pointers in size */
+    unsigned char ValOnHeap : 2;    /* this Value is on the heap - the MemoryLocation it was allocated with */
+    bool ValOnStack : 1;            /* the AnyValue is on the stack along with this Value */
+    bool AnyValOnHeap : 1;          /* the AnyValue is separately allocated from the Value on the heap */
+    bool IsLValue : 1;              /* is modifiable and is allocated somewhere we can usefully modify it */
+    bool OutOfScope : 1;
+	bool isAbsolute : 1;            /* Data_ is an absolute pointer rather than a virtual one */
+	bool isAnyValueAllocated : 1;   /* Data_ was allocated separately and is freed with this Value */
+    unsigned char ValInPool : 6;    /* if this Value (and its AnyValue if small) is a ValuePool block, the block's class */
+	unsigned char valueCreationSource : 4;  /* which allocator made this Value, for debugging */
 	UnionAnyValuePointer getVal_();
 	void setVal_(UnionAnyValuePointer newVal);
 	UnionAnyValuePointer getValAbsolute();
@@ -472,11 +652,6 @@ public:
 	void setValVirtual(Picoc *pc, UnionAnyValuePointerVirtual newVal);
 	void writeToVirtualFromAbsolute(Picoc *pc, void* newVal,size_t Size);
 	void writeToAbsoluteFromVirtual(Picoc *pc, UnionAnyValuePointerVirtual newVal,size_t Size);
-	bool isAbsolute;
-	bool isAnyValueAllocated;
-private:
-	UnionAnyValuePointer Val_;            /* pointer to the AnyValue which holds the actual content */
-	UnionAnyValuePointer ValAbsolute_;            /* pointer to the AnyValue which holds the actual content */
 public:
 	/* expression.c */
 	long ExpressionCoerceInteger(Picoc *pc);
@@ -488,7 +663,6 @@ public:
 	/* type.c */
 	int TypeSizeValue(int Compact);
 	int TypeStackSizeValue();
-	int valueCreationSource;
 };
 
 template<typename TN>
@@ -545,8 +719,9 @@ public:
     const char *DeclFileName;       /* where the variable was declared */
     unsigned short DeclLine;
     unsigned short DeclColumn;
-	std::string identifier_;
 	char freeValueEntryVal;
+	char Deleted;                   /* removed but not yet compacted out of the table */
+	char Hidden;                    /* out of scope - kept but not found by searches */
     union TableEntryPayload
     {
         struct ValueEntry
@@ -574,23 +749,21 @@ public:
    
 
 using TableIdentifierKey = const char * ;
-using TableMapClass = std::list<struct TableEntry* >;
-//using TableMapPair = std::list< struct TableEntry*>;
+/* entries are kept inline in insertion order. a separate open-addressing index of entry positions, 
+ * hashed on the key pointer, makes lookups O(1) while iteration stays deterministic (newest first) */
+using TableMapClass = std::vector<struct TableEntry>;
 struct Table
 {
 	/* table.c */
 	Table();
 	~Table();
-	//void TableInitTable(struct TableEntry **HashTable, int Size, bool OnHeap);
-	//void TableInitTable(std::map<std::string,struct TableEntry*> *hashTable) ;
-	void Table::TableInitTable(std::vector<struct TableEntry> &HashTable, size_t Size, bool OnHeap);
 	bool TableGet(const char *Key, struct Value **Val, const char **DeclFileName, int *DeclLine, int *DeclColumn);
 	bool TableGet(const char *Key, struct ValueAbs **Val, const char **DeclFileName, int *DeclLine, int *DeclColumn);
 	struct TableEntry *TableSearch(const char *Key);
 	bool Table::TableSet(const char *Key, struct Value *Val, const char *DeclFileName, int DeclLine, int DeclColumn);
 	bool Table::TableSet(const char *Key, struct ValueAbs *Val, const char *DeclFileName, int DeclLine, int DeclColumn);
 	struct Value *Table::TableDelete(const char *Key);
-	void TableSet(const char *Key, struct TableEntry* newEntry);
+	void TableSet(const char *Key, const struct TableEntry &NewEntry);
 	void Table::TableFree();
 	void Table::TableFree(Picoc *pc, void(func)(Picoc*, struct TableEntry *));
 	void Table::TableForEach(Picoc *pc, const std::function< void(Picoc*, struct TableEntry *)> &func);
@@ -598,11 +771,193 @@ struct Table
 	struct TableEntry * Table::TableFindEntryIf(Picoc *pc, const std::function< bool(Picoc*, struct TableEntry *)> &func);
 	bool Table::TableDeleteIf(Picoc *pc, const std::function< bool(Picoc*, struct TableEntry *)> &func);
 
-	struct TableEntry *TableSearchIdentifier(const std::string &Key);
-	const char *Table::TableSetIdentifier(const char *Ident, int IdentLen);
+
+	/* block scopes. each block's visible entries are pushed on a stack and hidden again when the block ends */
+	int TableScopeMark();
+	void TableScopeAdd(const char *Key, struct Value *Val);
+	void TableScopeAddSlot(struct Value *Val);
+	void TableScopeEnd(int Mark);
+	struct Value *TableReveal(const char *Key, const char *DeclFileName, int DeclLine, int DeclColumn);
+	bool TableIsHidden(const char *Key);
+
+	/* binding cells. a cell always holds the visible value for its key, or NULL, and stays put */
+	struct Value **TableBind(const char *Key);
+
+	/* the entries there now can be gone back to with TableRewind() */
+	void TableSeal();
+	bool TableRewind(Picoc *pc, const std::function< void(Picoc*, struct TableEntry *)> &func);
+
+private:
+	struct TableEntry *TableInsert(const char *Key);
+	void TableRemove(size_t EntryNo);
+	void TableRehash(size_t MinSlots);
+	void TableRebind(const char *Key);
+
+	TableMapClass hashTable_;        /* the entries, oldest first */
+	std::vector<int> Slots_;         /* open-addressing index into hashTable_ */
+	size_t Deleted_;                 /* entries marked deleted but still in hashTable_ */
+	std::vector<std::pair<const char *, struct Value *>> ScopeStack_;  /* entries made visible by the open blocks. frame slots have no key */
+	std::unordered_map<const char *, struct Value *> Bindings_;        /* binding cells by key */
+	size_t Sealed_;                  /* how many entries TableSeal() kept - they're first in hashTable_ */
+	bool SealBroken_;                /* a sealed entry has been deleted so there's no going back */
+};
+
+/* the shared string store. strings are hashed on their bytes and kept contiguously in arena blocks 
+ * which never move, so a registered string's address can be used as its identity */
+#define INTERNER_BLOCK_SIZE 4096
+struct StringInterner
+{
+	StringInterner();
+	~StringInterner();
+	const char *InternerRegister(const char *Str, int Len);
+	void InternerFree();
+	void InternerSeal();
+	void InternerRewind();
+
+private:
+	struct InternSlot
+	{
+		unsigned int Hash;
+		int Len;
+		const char *Str;
+	};
+	struct InternBlock
+	{
+		char *Mem;
+		size_t Size;
+	};
+	char *InternerAlloc(int Size);
+	void InternerRehash(size_t NumSlots);
+
+	std::vector<struct InternSlot> Slots_;  /* open-addressing index, Str == nullptr if empty */
+	size_t Count_;
+	std::vector<struct InternBlock> Blocks_;  /* the arena */
+	char *BlockPos_;
+	size_t BlockLeft_;
+
+	/* the arena and index at InternerSeal() */
+	std::vector<struct InternSlot> SealSlots_;
+	size_t SealCount_;
+	size_t SealBlocks_;
+	char *SealPos_;
+	size_t SealLeft_;
+};
+
+/* the memory a script's pointers may reach - the storage of its variables, the virtual stack, the script 
+ * heap and the string literals. none of it holds anything of the interpreter's own, so however a script 
+ * makes its pointers it can't get at Values, block headers or function pointers through them. addresses are 
+ * the host's own. mapped segments are kept by address, and the last ones found are kept in a small cache 
+ * by page so most checks never search */
+#define SPACE_PAGE_SHIFT 12
+#define SPACE_CACHE_SIZE 64
+struct AddressSpace
+{
+	AddressSpace();
+	void SpaceMap(const void *Base, size_t Size);
+	void SpaceUnmap(const void *Base, size_t Size);
+	bool SpaceCheck(const void *Addr, size_t Size)
+	{
+		uintptr_t Start = (uintptr_t)Addr;
+		const struct SpaceSegment &Hit = Cache_[(Start >> SPACE_PAGE_SHIFT) % SPACE_CACHE_SIZE];
+		
+		if (Start >= Hit.Start && Start < Hit.End && Size <= Hit.End - Start)
+			return true;
+		
+		return SpaceWalk(Addr, Size);
+	}
+	size_t SpaceExtent(const void *Addr);
+
+private:
+	struct SpaceSegment
+	{
+		uintptr_t Start;
+		uintptr_t End;
+	};
+	bool SpaceWalk(const void *Addr, size_t Size);
+	bool SpaceFind(uintptr_t Addr, struct SpaceSegment *Found);
+	void SpaceFlush();
+
+	std::map<uintptr_t, uintptr_t> Segments_;      /* the start and end of each mapped segment */
+	struct SpaceSegment Cache_[SPACE_CACHE_SIZE];   /* segments found lately, by the page of the address they were found for */
+};
+
+/* small blocks in size classes, carved from big chunks. freed blocks go on a free list for their 
+ * class and all the chunks are released together. released chunks are kept on a per-thread spare 
+ * list for the next pool on the thread to start from */
+#define POOL_GRANULE 16                 /* size classes go up in steps of this */
+#define POOL_CLASSES 32                 /* so the biggest block is POOL_GRANULE * POOL_CLASSES */
+#define POOL_CHUNK_SIZE 16384
+#define POOL_SPARE_CHUNKS 64            /* the most released chunks a thread keeps */
+struct SizeClassPool
+{
+	SizeClassPool();
+	~SizeClassPool();
+	static int PoolClass(int Size) { return (Size <= 0 || Size > POOL_GRANULE * POOL_CLASSES) ? 0 : (Size + POOL_GRANULE - 1) / POOL_GRANULE; }
+	void *PoolAlloc(int Class);
+	void PoolFree(void *Mem, int Class);
+	void PoolRelease();
+	void PoolSetSpace(struct AddressSpace *Space) { Space_ = Space; }
+
 private:
-	//TableMapClass publicMap;
-	TableMapClass hashTable_;
+	struct AddressSpace *Space_;            /* where chunks are mapped while the pool has them, if anywhere */
+	std::vector<char *> Chunks_;
+	char *ChunkPos_;
+	size_t ChunkLeft_;
+	void *FreeLists_[POOL_CLASSES + 1];     /* by class, 0 is unused */
+};
+
+/* the memory a script gets from malloc() and friends. small blocks come from size classes and 
+ * big ones from the system. all of it goes at once when the instance does, so nothing a script 
+ * forgot to free outlives it. what's known about each block is kept apart from it, where the 
+ * script can't reach it, and that's also how pointers it didn't get from here are told apart */
+struct ScriptHeap
+{
+	ScriptHeap();
+	~ScriptHeap();
+	void *ScriptAlloc(size_t Size);
+	void *ScriptRealloc(void *Mem, size_t Size);
+	void ScriptFree(void *Mem);
+	void ScriptRelease();
+	bool ScriptIsBlock(void *Mem) const { return Mem == NULL || Blocks_.find(Mem) != Blocks_.end(); }
+	size_t ScriptSize(void *Mem) const;
+	void ScriptForEach(const std::function<void(void *, size_t)> &Func) const;
+	size_t BytesInUse() const { return BytesInUse_; }
+	size_t PeakBytes() const { return PeakBytes_; }
+	size_t AllocCount() const { return AllocCount_; }
+	void ScriptUseHugePages(bool Use) { HugePages_ = Use; }
+	void ScriptSetSpace(struct AddressSpace *Space) { Space_ = Space; Pool_.PoolSetSpace(Space); }
+
+private:
+	struct ScriptBlock
+	{
+		size_t Size;                        /* what the script asked for */
+		int Class;                          /* the size class, or 0 for a big block */
+	};
+	void *ScriptAllocClass(int Class);
+
+	struct SizeClassPool Pool_;
+	struct AddressSpace *Space_;
+	std::unordered_map<void *, struct ScriptBlock> Blocks_;    /* every live block, by address */
+	std::vector<void *> FreeBlocks_[POOL_CLASSES + 1];         /* freed small blocks by class, 0 is unused */
+	size_t BytesInUse_;
+	size_t PeakBytes_;
+	size_t AllocCount_;                     /* every allocation made, not just the live ones */
+	bool HugePages_;
+};
+
+/* memory limits for an instance, in bytes. 0 means no limit. going over one is a program failure */
+struct MemoryQuota
+{
+    size_t StackBytes;                  /* each of the interpreter's stacks */
+    size_t ScriptHeapBytes;             /* what the script has malloc()ed */
+    size_t InternalBytes;               /* the interpreter's own heap - tables, tokens, types, globals */
+};
+
+/* a position on the stack and the virtual stack, for freeing an expression's temporaries all at once */
+struct StackMark
+{
+    void *Top;
+    void *TopVirtual;
 };
 
 /* stack frame for function calls */
@@ -624,6 +979,11 @@ public:
     int NumParams;                          /* the number of parameters */
     std::shared_ptr<struct Table> LocalTable;                /* the local variables and parameters */
     StructStackFrame *PreviousStackFrame;  /* the next lower stack frame */
+    std::shared_ptr<struct FrameLayout> Layout;  /* the function's frame layout, if it's a user-defined function */
+    struct Value *SlotValues;               /* the values for each slot, MEM_ALIGN(sizeof(struct Value)) apart */
+    char *SlotData;                         /* the frame block */
+    int NumSlots;                           /* how many slots this call has room for */
+    std::vector<std::pair<void *, bool>> ReallocData;  /* heap blocks locals were resized into, and whether each is absolute */
 };
 
 /* lexer state */
@@ -705,14 +1065,13 @@ struct IncludeLibrary
 
 const int FREELIST_BUCKETS = 8;                          /* freelists for 4, 8, 12 ... 32 byte allocs */
 const int SPLIT_MEM_THRESHOLD = 16;                      /* don't split memory which is close in size */
-const int BREAKPOINT_TABLE_SIZE = 21;
 
 
 /* the entire state of the picoc system */
 struct Picoc_Struct
 {
 public:
-	Picoc_Struct(size_t StackSize);
+	Picoc_Struct(size_t StackSize, size_t StackLimit = 0, bool HugePages = false);     /* the stacks can grow to StackLimit if it's bigger than StackSize */
 	~Picoc_Struct();
     /* parser global data */
     struct Table GlobalTable;
@@ -725,7 +1084,6 @@ public:
     bool LexUseStatementPrompt;
     UnionAnyValue LexAnyValue;
     struct ValueAbs LexValue;
-    struct Table ReservedWordTable;
     /* the table of string literal values */
     struct Table StringLiteralTable;
 	/* the stack */
@@ -752,6 +1110,10 @@ public:
 	void *HeapBottomVirtual;                   /* the bottom of the (downward-growing) heap */
 	std::vector<void *> CurrentStackFrameVirtual;                   /* the current stack frame */
 	void *HeapStackTopVirtual;                 /* the top of the stack */
+	size_t HeapStackLimit;              /* the most either stack can grow to */
+	size_t HeapStackCommitted;          /* how much of each stack is usable so far */
+	size_t HeapStackCommittedVirtual;
+	bool HeapStackOverQuota;            /* the last stack that couldn't grow was stopped by its quota */
 
 #else
 # ifdef SURVEYOR_HOST
@@ -767,10 +1129,21 @@ public:
     void *HeapStackTop;                 /* the top of the stack */
 # endif
 #endif
+    struct AddressSpace Space;          /* what script pointers are allowed to reach */
 #ifndef USE_MALLOC_HEAP
     std::vector<struct AllocNode *>FreeListBucket;      /* we keep a pool of freelist buckets to reduce fragmentation */
     struct AllocNode *FreeListBig;                           /* free memory which doesn't fit in a bucket */
 #endif
+#ifdef USE_MALLOC_HEAP
+    struct SizeClassPool HeapSlab;      /* small HeapAllocMem() blocks */
+#endif
+    struct SizeClassPool ValuePool;     /* heap Values together with their small AnyValues */
+    struct ScriptHeap ScriptMem;        /* what the script malloc()s */
+    struct ScriptHeap DataMem;          /* the storage of global and static variables */
+    struct MemoryQuota Quota;
+    size_t InternalBytes;               /* the interpreter's own heap in use, for Quota.InternalBytes */
+    bool HugePages;                     /* back the stacks and big heap blocks with huge pages where we can. this rounds the 
+                                         * stacks up to whole 2MB huge pages. heap blocks smaller than that aren't affected */
     /* types */    
     struct ValueType UberType;
     struct ValueType IntType;
@@ -794,11 +1167,29 @@ public:
     struct ValueType *CharPtrPtrType;
     struct ValueType *CharArrayType;
     struct ValueType *VoidPtrType;
+    struct MemberList NoMembers;        /* marks a type as defined when it has no members of its own */
+
+    /* every derived type, by parent, base, array size and identifier */
+    std::unordered_map<struct DerivedTypeKey, struct ValueType *, struct DerivedTypeKeyHash> DerivedTypes;
+
+    /* parsed types by token position */
+    std::unordered_map<const unsigned char *, struct TypeCacheEntry> TypeFrontCache;
+    std::unordered_map<const unsigned char *, struct TypeCacheEntry> TypeIdentCache;
+    unsigned int TypeCacheEpoch;        /* bumped when a typedef changes what a name means */
+    int TypeCacheable;                  /* cleared when the current type parse had side effects */
+
+    /* resolved identifiers by token position */
+    std::unordered_map<const unsigned char *, struct VariableCacheEntry> VariableCache;
+    struct Value *ReturnSlot;           /* the running return statement's slot, for the first call in it returning its type */
+    std::unordered_map<const unsigned char *, std::shared_ptr<struct FrameLayout>> FrameLayouts;  /* by function body */
+    std::deque<struct ExpressionStack> ExpressionStacks;  /* by ExpressionParse() nesting depth */
+    int ExpressionDepth;                /* how many ExpressionParse()s are running */
 
     /* debugger */
-    struct Table BreakpointTable;
+    std::unordered_set<struct BreakpointKey, struct BreakpointKeyHash> Breakpoints;
 	int BreakpointCount;
     int DebugManualBreak;
+    void (ParseState::*DebugHook)();    /* run before each statement in debug mode, NULL while there's nothing to check */
     
     /* C library */
     int BigEndian;
@@ -806,10 +1197,23 @@ public:
 
     IOFILE *CStdOut;
     IOFILE CStdOutBase;
+    void *TimeBuffer;                   /* what gmtime() and localtime() hand back, somewhere the program can read it */
+    std::unordered_set<void *> Streams; /* the FILEs the program's been handed, which are all stdio takes from it */
+    char *StrtokNext;                   /* where strtok() carries on from */
 
     /* the picoc version string */
     const char *VersionString;
     
+    /* the reset point, which Reset() takes the instance back to. the tables and the string table keep their own */
+    std::vector<struct TypeSealEntry> ResetTypes;
+    size_t ResetTokens;                 /* how many token chunks CleanupTokenList had */
+    std::vector<void *> ResetStackFrame;
+    std::vector<void *> ResetStackFrameVirtual;
+    void *ResetStackTop;
+    void *ResetStackTopVirtual;
+    std::vector<std::pair<void *, size_t>> ResetDataBlocks;   /* the program data blocks there were, and their sizes */
+    std::vector<char> ResetData;        /* what they held, one after another */
+    
     /* exit longjump buffer */
 #if defined(UNIX_HOST) || defined(WIN32)
     jmp_buf PicocExitBuf;
@@ -819,10 +1223,12 @@ public:
 #endif
     
     /* string table */
-    struct Table StringTable;
+    struct StringInterner StringTable;
 	const char *StrEmpty;
 	/* platform.c */
 	void PicocCallMain(int argc, char **argv);
+	void PicocSetResetPoint();
+	bool Reset();
 
 	/* table.c */
 	void TableInit();
@@ -831,9 +1237,9 @@ public:
 	//void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable, int Size, int OnHeap);
 	int TableSet(struct Table *Tbl, const char *Key, struct Value *Val, const char *DeclFileName, int DeclLine, int DeclColumn);
 	int TableSet(struct Table *Tbl, const char *Key, struct ValueAbs *Val, const char *DeclFileName, int DeclLine, int DeclColumn);
+	void TableNoteLocalName(struct Table *Tbl, const char *Key);
 	//int TableGet(struct Table *Tbl, const char *Key, struct Value **Val, const char **DeclFileName, int *DeclLine, int *DeclColumn);
 	struct Value *TableDelete(struct Table *Tbl, const char *Key);
-	const char *TableSetIdentifier(struct Table *Tbl, const char *Ident, int IdentLen);
 	void TableStrFree();
 	struct Table * GetCurrentTable();
 	/* lex.c */
@@ -848,8 +1254,9 @@ public:
 	void LexInteractiveClear( struct ParseState *Parser);
 	void LexInteractiveCompleted( struct ParseState *Parser);
 	void LexInteractiveStatementPrompt();
+	void LexTokenCacheClear();
 	// added
-	enum LexToken LexCheckReservedWord(const char *Word);
+	enum LexToken LexCheckReservedWord(const char *Word, int Len);
 	enum LexToken LexGetNumber(struct LexState *Lexer, struct Value *Value);
 	enum LexToken LexGetWord(struct LexState *Lexer, struct ValueAbs *Value);
 	enum LexToken LexGetStringConstant(struct LexState *Lexer, struct Value *Value, char EndChar);
@@ -866,17 +1273,42 @@ public:
 	void TypeCleanup();
 	void TypeAddBaseType(struct ValueType *TypeNode, enum BaseType Base, int Sizeof, int AlignBytes);
 	void TypeCleanupNode(struct ValueType *Typ);
+	void TypeCacheClear();
+	void TypeSeal();
+	void TypeSealNode(struct ValueType *Typ);
+	void TypeRewind();
+	void TypeFreeNode(struct ValueType *Typ);
 	/* heap.c */
 	void HeapInit( int StackSize);
+	bool HeapStackGrow(void *NewTop, bool Virtual);
+#ifdef USE_MALLOC_STACK
+	void HeapStackSetBottom(bool Virtual);
+#endif
+	void PicocSetQuota(const struct MemoryQuota &NewQuota);
+	void HeapQuotaCharge(size_t Size)
+	{
+		if (Quota.InternalBytes != 0 && InternalBytes + Size > Quota.InternalBytes)
+			ProgramFailNoParser("interpreter memory quota of %d bytes exceeded", (int)Quota.InternalBytes);
+		InternalBytes += Size;
+	}
+	void HeapQuotaRelease(size_t Size) { InternalBytes -= Size; }
 	void HeapCleanup();
+#ifdef USE_MALLOC_HEAP
+	void HeapSlabFree(void *Mem);
+#endif
 	void *HeapAllocStack( int Size);
+	void *HeapAllocStackUncleared( int Size);
 	void *HeapAllocStackVirtual(int Size);
 	bool HeapPopStack( void *Addr, int Size);
-	void HeapUnpopStack( int Size);
+	struct StackMark HeapMarkStack();
+	void HeapResetStack(const struct StackMark &Mark);
 	void HeapPushStackFrame();
 	void HeapPopStackFrame();
+	void HeapSeal();
+	void HeapRewind();
 	void *HeapAllocMem( int Size);
 	void *HeapAllocVirtualMem(int Size);
+	void HeapFreeVirtualMem(void *Mem);
 	void HeapFreeMem(UnionAnyValuePointer  Mem);
 	void HeapFreeMem( void *Mem);
 
@@ -887,9 +1319,11 @@ public:
 		void VariableInit();
 	void VariableCleanup();
 	void VariableFree(struct Value *Val);
+	void VariableCacheClear();
 	void VariableTableCleanup( struct Table *HashTable);
 	int VariableDefined( const char *Ident);
 	bool VariableDefinedAndOutOfScope( const char *Ident);
+	struct Value *VariableSlotGet( const char *Ident, bool OutOfScope);
 	struct Value *VariableStringLiteralGet( const char *Ident);
 	void VariableStringLiteralDefine( const char *Ident, struct Value *Val);
 	void VariableDefinePlatformVar(const char *Ident, struct ValueType *Typ,
@@ -922,6 +1356,8 @@ public:
 	/* debug.c */
 	void DebugInit();
 	void DebugCleanup();
+	void DebugUpdateHook();
+	void DebugRequestBreak();
 	char *PlatformReadFile( const char *FileName);
 	void PicocPlatformScanFile(const char *FileName);
 	Picoc_Struct() : Picoc_Struct(picocStackSize){};
@@ -934,6 +1370,25 @@ private:
 	int IntAlignBytes;
 };
 
+/* hands out instances which have all been prepared the same way, typically by including the system 
+ * headers. making and preparing an instance takes longer than a small program takes to run, so rather 
+ * than copying one the template keeps the instances it's given back, Reset() to their reset point, 
+ * and hands those out again. it can be shared between threads */
+struct PicocTemplate
+{
+	PicocTemplate(size_t StackSize, void (*Prepare)(Picoc *pc) = nullptr, size_t MaxIdle = 16);
+	~PicocTemplate();
+	Picoc *TemplateClone();
+	void TemplateRecycle(Picoc *pc);
+
+private:
+	size_t StackSize_;
+	void (*Prepare_)(Picoc *pc);        /* run on each new instance before its reset point is set */
+	size_t MaxIdle_;                    /* the most instances kept waiting */
+	std::vector<Picoc *> Idle_;
+	std::mutex IdleLock_;
+};
+
 
 /* type.c */
 int TypeSize(struct ValueType *Typ, int ArraySize, int Compact);
@@ -28,71 +28,10 @@
 #define MAX_CHAR_VALUE 255      /* maximum value which can be represented by a "char" data type */
 
 
-struct ReservedWord
-{
-    const char *Word;
-    enum LexToken Token;
-};
-
-static struct ReservedWord ReservedWords[] =
-{
-    { "#define", TokenHashDefine },
-    { "#else", TokenHashElse },
-    { "#endif", TokenHashEndif },
-    { "#if", TokenHashIf },
-    { "#ifdef", TokenHashIfdef },
-    { "#ifndef", TokenHashIfndef },
-    { "#include", TokenHashInclude },
-    { "auto", TokenAutoType },
-    { "break", TokenBreak },
-    { "case", TokenCase },
-    { "char", TokenCharType },
-    { "continue", TokenContinue },
-    { "default", TokenDefault },
-    { "delete", TokenDelete },
-    { "do", TokenDo },
-#ifndef NO_FP
-    { "double", TokenDoubleType },
-#endif
-    { "else", TokenElse },
-    { "enum", TokenEnumType },
-    { "extern", TokenExternType },
-#ifndef NO_FP
-    { "float", TokenFloatType },
-#endif
-    { "for", TokenFor },
-    { "goto", TokenGoto },
-    { "if", TokenIf },
-    { "int", TokenIntType },
-    { "long", TokenLongType },
-    { "new", TokenNew },
-    { "register", TokenRegisterType },
-    { "return", TokenReturn },
-    { "short", TokenShortType },
-    { "signed", TokenSignedType },
-    { "sizeof", TokenSizeof },
-    { "static", TokenStaticType },
-    { "struct", TokenStructType },
-    { "switch", TokenSwitch },
-    { "typedef", TokenTypedef },
-    { "union", TokenUnionType },
-    { "unsigned", TokenUnsignedType },
-    { "void", TokenVoidType },
-    { "while", TokenWhile }
-};
-
-
-
 /* initialise the lexer */
 void Picoc::LexInit()
 {
 	Picoc *pc = this;
-    int Count;
-    
-	for (Count = 0; Count < sizeof(ReservedWords) / sizeof(struct ReservedWord); Count++)
-    {
-		pc->ReservedWordTable.TableSet(TableStrRegister(ReservedWords[Count].Word), (struct Value *)&ReservedWords[Count], nullptr, 0, 0);
-    }
     
     pc->LexValue.TypeOfValue = nullptr;
     pc->LexValue.setValAbsolute(pc,  &pc->LexAnyValue );
@@ -109,18 +48,100 @@ void Picoc::LexCleanup()
     LexInteractiveClear( nullptr);
 }
 
-/* check if a word is a reserved word - used while scanning */
-enum LexToken Picoc::LexCheckReservedWord(const char *Word)
+/* matches a reserved word of known length */
+#define RESERVED(w,t) if (memcmp(Word, (w), Len) == 0) return (t)
+
+/* check if a word is a reserved word - used while scanning. 
+ * this is a fixed trie on the length and first character of the raw word so it runs before the word is registered */
+enum LexToken Picoc::LexCheckReservedWord(const char *Word, int Len)
 {
-	Picoc *pc = this;
-    struct Value *val;
+    switch (Len)
+    {
+        case 2:
+            switch (Word[0])
+            {
+                case 'd': RESERVED("do", TokenDo); break;
+                case 'i': RESERVED("if", TokenIf); break;
+            }
+            break;
+            
+        case 3:
+            switch (Word[0])
+            {
+                case '#': RESERVED("#if", TokenHashIf); break;
+                case 'f': RESERVED("for", TokenFor); break;
+                case 'i': RESERVED("int", TokenIntType); break;
+                case 'n': RESERVED("new", TokenNew); break;
+            }
+            break;
+            
+        case 4:
+            switch (Word[0])
+            {
+                case 'a': RESERVED("auto", TokenAutoType); break;
+                case 'c': RESERVED("case", TokenCase); RESERVED("char", TokenCharType); break;
+                case 'e': RESERVED("else", TokenElse); RESERVED("enum", TokenEnumType); break;
+                case 'g': RESERVED("goto", TokenGoto); break;
+                case 'l': RESERVED("long", TokenLongType); break;
+                case 'v': RESERVED("void", TokenVoidType); break;
+            }
+            break;
+            
+        case 5:
+            switch (Word[0])
+            {
+                case '#': RESERVED("#else", TokenHashElse); break;
+                case 'b': RESERVED("break", TokenBreak); break;
+#ifndef NO_FP
+                case 'f': RESERVED("float", TokenFloatType); break;
+#endif
+                case 's': RESERVED("short", TokenShortType); break;
+                case 'u': RESERVED("union", TokenUnionType); break;
+                case 'w': RESERVED("while", TokenWhile); break;
+            }
+            break;
+            
+        case 6:
+            switch (Word[0])
+            {
+                case '#': RESERVED("#endif", TokenHashEndif); RESERVED("#ifdef", TokenHashIfdef); break;
+                case 'd': RESERVED("delete", TokenDelete); 
+#ifndef NO_FP
+                    RESERVED("double", TokenDoubleType); 
+#endif
+                    break;
+                case 'e': RESERVED("extern", TokenExternType); break;
+                case 'r': RESERVED("return", TokenReturn); break;
+                case 's': RESERVED("signed", TokenSignedType); RESERVED("sizeof", TokenSizeof); 
+                    RESERVED("static", TokenStaticType); RESERVED("struct", TokenStructType); RESERVED("switch", TokenSwitch); break;
+            }
+            break;
+            
+        case 7:
+            switch (Word[0])
+            {
+                case '#': RESERVED("#define", TokenHashDefine); RESERVED("#ifndef", TokenHashIfndef); break;
+                case 'd': RESERVED("default", TokenDefault); break;
+                case 't': RESERVED("typedef", TokenTypedef); break;
+            }
+            break;
+            
+        case 8:
+            switch (Word[0])
+            {
+                case '#': RESERVED("#include", TokenHashInclude); break;
+                case 'c': RESERVED("continue", TokenContinue); break;
+                case 'r': RESERVED("register", TokenRegisterType); break;
+                case 'u': RESERVED("unsigned", TokenUnsignedType); break;
+            }
+            break;
+    }
     
-	if (pc->ReservedWordTable.TableGet(Word, &val, NULL, NULL, NULL))
-        return ((struct ReservedWord *)val)->Token;
-    else
-        return TokenNone;
+    return TokenNone;
 }
 
+#undef RESERVED
+
 /* get a numeric literal - used while scanning */
 enum LexToken Picoc::LexGetNumber(struct LexState *Lexer, struct Value *Value)
 {
@@ -243,9 +264,7 @@ enum LexToken Picoc::LexGetWord( struct LexState *Lexer, struct ValueAbs *Value)
     } while (Lexer->Pos != Lexer->End && isCident((int)*Lexer->Pos));
     
     Value->TypeOfValue = NULL;
-    Value->ValIdentifierOfAnyValue(pc) = TableStrRegister2( StartPos, Lexer->Pos - StartPos);
-    
-    Token = LexCheckReservedWord(Value->ValIdentifierOfAnyValue(pc));
+    Token = LexCheckReservedWord(StartPos, Lexer->Pos - StartPos);
     switch (Token)
     {
         case TokenHashInclude: Lexer->Mode = LexModeHashInclude; break;
@@ -256,6 +275,7 @@ enum LexToken Picoc::LexGetWord( struct LexState *Lexer, struct ValueAbs *Value)
     if (Token != TokenNone)
         return Token;
     
+    Value->ValIdentifierOfAnyValue(pc) = TableStrRegister2( StartPos, Lexer->Pos - StartPos);
     if (Lexer->Mode == LexModeHashDefineSpace)
         Lexer->Mode = LexModeHashDefineSpaceIdent;
     
@@ -327,6 +347,7 @@ enum LexToken Picoc::LexGetStringConstant( struct LexState *Lexer, struct Value
     const char *EndPos;
     char *EscBuf;
     char *EscBufPos;
+    int Len;
     const char *RegString;
     struct Value *ArrayValue;
     
@@ -363,7 +384,8 @@ enum LexToken Picoc::LexGetStringConstant( struct LexState *Lexer, struct Value
         *EscBufPos++ = LexUnEscapeCharacter(&Lexer->Pos, EndPos);
     
     /* try to find an existing copy of this string literal */
-    RegString = TableStrRegister2( EscBuf, EscBufPos - EscBuf);
+    Len = EscBufPos - EscBuf;
+    RegString = TableStrRegister2( EscBuf, Len);
     HeapPopStack( EscBuf, EndPos - StartPos);
     ArrayValue = VariableStringLiteralGet( RegString);
     if (ArrayValue == nullptr)
@@ -372,16 +394,17 @@ enum LexToken Picoc::LexGetStringConstant( struct LexState *Lexer, struct Value
 		temp.setScopeID(-1);
 		temp.pc = pc;
 
-		/* create and store this string literal */
-       ArrayValue = temp.VariableAllocValueAndData( 0, FALSE, NULL, LocationOnHeap);
+		/* create and store this string literal. the script gets its own copy, in memory it's allowed to 
+		 * reach, so nothing it does through the pointer can get at the shared strings */
+        ArrayValue = temp.VariableAllocValueAndData( Len + 1, FALSE, NULL, LocationOnHeapVirtual);
         ArrayValue->TypeOfValue = pc->CharArrayType;
-        ArrayValue->setValAbsolute(pc,  (UnionAnyValuePointer )RegString );
+        memcpy((void *)ArrayValue->getValVirtual(), RegString, Len + 1);
         VariableStringLiteralDefine( RegString, ArrayValue);
     }
 
     /* create the the pointer for this char* */
     Value->TypeOfValue = pc->CharPtrType;
-    Value->setVal<PointerType>(pc,  const_cast<void*>(static_cast<const void*>(RegString))); // unsafe assignment and unsafe cast @todo \todo 
+    Value->setVal<PointerType>(pc, (PointerType)ArrayValue->getValVirtual());
     if (*Lexer->Pos == EndChar)
         LEXER_INC(Lexer);
     
@@ -914,6 +937,10 @@ enum LexToken ParseState::LexGetToken(struct ValueAbs **Value, int IncPos)
             default:                WasPreProcToken = FALSE; break;
         }
 
+        /* a type parse which crosses a directive depends on more than its tokens */
+        if (WasPreProcToken)
+            pc->TypeCacheable = FALSE;
+
         /* if we're going to reject this token, increment the token pointer to the next one */
         TryNextToken = (Parser->HashIfEvaluateToLevel < Parser->HashIfLevel && Token != TokenEOF) || WasPreProcToken;
         if (!IncPos && TryNextToken)
@@ -1054,3 +1081,11 @@ void Picoc::LexInteractiveStatementPrompt()
 {
     this->LexUseStatementPrompt = true;
 }
+
+/* forget everything cached against token positions - call when tokens are freed */
+void Picoc::LexTokenCacheClear()
+{
+    TypeCacheClear();
+    VariableCacheClear();
+    FrameLayouts.clear();
+}
@@ -31,6 +31,7 @@ void Picoc::ParseCleanup()
 		//pc->CleanupTokenList = Next;
 		pc->CleanupTokenList.pop_front();
 	}
+	LexTokenCacheClear();
 
 }
 
@@ -223,6 +224,9 @@ int ParseState::ParseArrayInitialiser(struct Value *NewVariable, int DoAssignmen
     Token = Parser->LexGetToken( NULL, FALSE);
     while (Token != TokenRightBrace)
     {
+        /* each element's temporaries are freed once it's been assigned */
+        struct StackMark Mark = Parser->pc->HeapMarkStack();
+
         if (Parser->LexGetToken( NULL, FALSE) == TokenLeftBrace)
         {
             /* this is a sub-array initialiser */
@@ -285,11 +289,10 @@ int ParseState::ParseArrayInitialiser(struct Value *NewVariable, int DoAssignmen
             if (Parser->Mode == RunModeRun && DoAssignment)
             {
                 Parser->ExpressionAssign( ArrayElement, CValue, FALSE, NULL, 0, FALSE);
-                Parser->VariableStackPop( CValue);
-                Parser->VariableStackPop( ArrayElement);
             }
         }
         
+        Parser->pc->HeapResetStack(Mark);
         ArrayIndex++;
 
         Token = Parser->LexGetToken( NULL, FALSE);
@@ -325,14 +328,14 @@ void ParseState::ParseDeclarationAssignment(struct Value *NewVariable, int DoAss
     else
     {
         /* this is a normal expression initialiser */
+        struct StackMark Mark = Parser->pc->HeapMarkStack();
         if (!ExpressionParse( &CValue))
             Parser->ProgramFail( "expression expected");
             
         if (Parser->Mode == RunModeRun && DoAssignment)
-        {
             Parser->ExpressionAssign( NewVariable, CValue, FALSE, NULL, 0, FALSE);
-            VariableStackPop( CValue);
-        }
+
+        Parser->pc->HeapResetStack(Mark);
     }
 }
 
@@ -494,7 +497,7 @@ void ParseState::ParseFor()
     if (Parser->LexGetToken( NULL, FALSE) == TokenSemicolon)
         Condition = TRUE;
     else
-        Condition = Parser->ExpressionParseInt();
+        Condition = Parser->ExpressionParseCondition();
     
     if (Parser->LexGetToken( NULL, TRUE) != TokenSemicolon)
         Parser->ProgramFail( "';' expected");
@@ -523,7 +526,7 @@ void ParseState::ParseFor()
         if (Parser->LexGetToken( NULL, FALSE) == TokenSemicolon)
             Condition = TRUE;
         else
-            Condition = Parser->ExpressionParseInt();
+            Condition = Parser->ExpressionParseCondition();
         
         if (Condition)
         {
@@ -595,6 +598,24 @@ void ParseState::ParseTypedef()
     }
 }
 
+/* offers a return statement's slot to the calls in its expression, and takes it back
+ * however the expression is left */
+struct ReturnSlotOffer
+{
+    Picoc *pc;
+    struct Value *OldSlot;
+
+    ReturnSlotOffer(Picoc *pc, struct Value *Slot) : pc(pc), OldSlot(pc->ReturnSlot)
+    {
+        pc->ReturnSlot = Slot;
+    }
+
+    ~ReturnSlotOffer()
+    {
+        pc->ReturnSlot = OldSlot;
+    }
+};
+
 /* parse a statement */
 enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
 {
@@ -606,9 +627,9 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
     struct ParseState PreState;
     enum LexToken Token;
     
-    /* if we're debugging, check for a breakpoint */
-    if (Parser->DebugMode && Parser->Mode == RunModeRun)
-        DebugCheckStatement();
+    /* if we're debugging, check for a breakpoint. the hook's only set while there are breakpoints or a break is pending */
+    if (pc->DebugHook != nullptr && Parser->DebugMode && Parser->Mode == RunModeRun)
+        (Parser->*pc->DebugHook)();
     
     /* take note of where we are and then grab a token to see what statement we have */   
     ParserCopy(&PreState, Parser);
@@ -621,9 +642,8 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
             
         case TokenIdentifier:
             /* might be a typedef-typed variable declaration or it might be an expression */
-			if (Parser->pc->VariableDefined(LexerValue->ValIdentifierOfAnyValue(pc)))
+			if ((VarValue = VariableLookup(PreState.Pos, LexerValue->ValIdentifierOfAnyValue(pc))) != NULL)
             {
-				VariableGet( LexerValue->ValIdentifierOfAnyValue(pc), &VarValue);
                 if (VarValue->TypeOfValue->Base == Type_Type)
                 {
                     *Parser = PreState;
@@ -681,11 +701,13 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
         case TokenIncrement: 
         case TokenDecrement: 
         case TokenOpenBracket: 
+        {
+            struct StackMark Mark = Parser->pc->HeapMarkStack();
             *Parser = PreState;
             Parser->ExpressionParse( &CValue);
-            if (Parser->Mode == RunModeRun) 
-                Parser->VariableStackPop( CValue);
+            Parser->pc->HeapResetStack(Mark);
             break;
+        }
             
         case TokenLeftBrace:
             ParseBlock( FALSE, TRUE);
@@ -696,7 +718,7 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
             if (Parser->LexGetToken( NULL, TRUE) != TokenOpenBracket)
                 Parser->ProgramFail( "'(' expected");
                 
-            Condition = Parser->ExpressionParseInt();
+            Condition = Parser->ExpressionParseCondition();
             
             if (Parser->LexGetToken( NULL, TRUE) != TokenCloseBracket)
                 Parser->ProgramFail( "')' expected");
@@ -725,7 +747,7 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
                 do
                 {
                     ParserCopyPos(Parser, &PreConditional);
-                    Condition = Parser->ExpressionParseInt();
+                    Condition = Parser->ExpressionParseCondition();
                     if (Parser->LexGetToken( NULL, TRUE) != TokenCloseBracket)
                         Parser->ProgramFail( "')' expected");
                     
@@ -764,7 +786,7 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
                     if (Parser->LexGetToken( NULL, TRUE) != TokenOpenBracket)
                         Parser->ProgramFail( "'(' expected");
                         
-                    Condition = Parser->ExpressionParseInt();
+                    Condition = Parser->ExpressionParseCondition();
                     if (Parser->LexGetToken( NULL, TRUE) != TokenCloseBracket)
                         Parser->ProgramFail( "')' expected");
                     
@@ -814,7 +836,7 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
             if (Parser->LexGetToken( &LexerValue, TRUE) != TokenStringConstant)
                 Parser->ProgramFail( "\"filename.h\" expected");
             
-			Parser->pc->IncludeFile((char *)LexerValue->getVal<PointerType>(pc));
+			Parser->pc->IncludeFile(Parser->pc->TableStrRegister((char *)LexerValue->getVal<PointerType>(pc)));
             CheckTrailingSemicolon = FALSE;
             break;
 #endif
@@ -889,19 +911,22 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
             break;
             
         case TokenReturn:
+        {
+            struct StackMark Mark = Parser->pc->HeapMarkStack();
             if (Parser->Mode == RunModeRun)
             {
                 if (!Parser->pc->TopStackFrame() || Parser->pc->TopStackFrame()->ReturnValue->TypeOfValue->Base != TypeVoid)
                 {
+                    /* let a struct-returning call in the expression write its result straight into our return value */
+                    struct ReturnSlotOffer Offer(Parser->pc, Parser->pc->TopStackFrame() ? Parser->pc->TopStackFrame()->ReturnValue : nullptr);
+                    
                     if (!Parser->ExpressionParse( &CValue))
                         Parser->ProgramFail( "value required in return");
                     
                     if (!Parser->pc->TopStackFrame()) /* return from top-level program? */
 						Parser->pc->PlatformExit(CValue->ExpressionCoerceInteger(pc), "value required in return");
-                    else
+                    else if (CValue->ValAddressOfData(pc) != Parser->pc->TopStackFrame()->ReturnValue->ValAddressOfData(pc))
                         Parser->ExpressionAssign( Parser->pc->TopStackFrame()->ReturnValue, CValue, TRUE, NULL, 0, FALSE);
-
-                    Parser->VariableStackPop( CValue);
                 }
                 else
                 {
@@ -913,7 +938,10 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
             }
             else
                 Parser->ExpressionParse( &CValue);
+
+            Parser->pc->HeapResetStack(Mark);
             break;
+        }
 
         case TokenTypedef:
             ParseTypedef();
@@ -945,6 +973,7 @@ enum ParseResult ParseState::ParseStatement(int CheckTrailingSemicolon)
                 if (CValue == NULL)
                     Parser->ProgramFail( "'%s' is not defined", LexerValue->ValIdentifierOfAnyValue(pc));
                 
+                Parser->pc->TypeCacheEpoch++;
 				Parser->pc->VariableFree( CValue);
             }
             break;
@@ -975,15 +1004,15 @@ void Picoc::PicocParse( const char *FileName, const char *Source, int SourceLen,
     
     void *Tokens = LexAnalyse( RegFileName, Source, SourceLen, NULL);
     
-    /* allocate a cleanup node so we can clean up the tokens later */
-    if (!CleanupNow)
+    /* allocate a cleanup node so we can clean up the tokens later. tokens which are freed 
+     * as soon as we're done get one too, in case the program fails before then */
     {
 		// obsolete NewCleanupNode = static_cast<CleanupTokenNode*>(HeapAllocMem( sizeof(struct CleanupTokenNode)));
         // obsolete if (NewCleanupNode == NULL)
         // obsolete     ProgramFailNoParser("out of memory");
         
         NewCleanupNode.Tokens = Tokens;
-        if (CleanupSource)
+        if (CleanupSource && !CleanupNow)
             NewCleanupNode.SourceText = Source;
         else
             NewCleanupNode.SourceText = NULL;
@@ -1004,7 +1033,11 @@ void Picoc::PicocParse( const char *FileName, const char *Source, int SourceLen,
     
     /* clean up */
     if (CleanupNow)
+    {
+        pc->CleanupTokenList.remove_if([Tokens](const struct CleanupTokenNode &Node) { return Node.Tokens == Tokens; });
         HeapFreeMem( Tokens);
+        LexTokenCacheClear();
+    }
 }
 
 /* parse interactively */
@@ -14,6 +14,50 @@
 
               /* space for the the stack */
 
+/* the memory quotas from the environment */
+static struct MemoryQuota PicocQuotaFromEnv()
+{
+	struct MemoryQuota Quota = {};
+
+	Quota.StackBytes = getenv("STACKQUOTA") ? atoi(getenv("STACKQUOTA")) : 0;
+	Quota.ScriptHeapBytes = getenv("HEAPQUOTA") ? atoi(getenv("HEAPQUOTA")) : 0;
+	Quota.InternalBytes = getenv("INTERNALQUOTA") ? atoi(getenv("INTERNALQUOTA")) : 0;
+	return Quota;
+}
+
+/* the headers are included once, before the reset point */
+static void PicocPrepare(Picoc *pc)
+{
+	pc->PicocIncludeAllSystemHeaders();
+}
+
+/* run the program twice on one instance, resetting it in between - the second run should go just like the first */
+static void PicocRunTwice(int argc, char **argv, int StackSize)
+{
+	PicocTemplate Template(StackSize, PicocPrepare, 1);
+
+	for (int Round = 0; Round < 2; ++Round){
+		Picoc *pc = Template.TemplateClone();
+
+		pc->PicocSetQuota(PicocQuotaFromEnv());
+		try{
+			if (!PicocPlatformSetExitPoint(pc))
+			{
+				int ParamCount = 2;
+
+				for (; ParamCount < argc && strcmp(argv[ParamCount], "-") != 0; ParamCount++)
+					pc->PicocPlatformScanFile(argv[ParamCount]);
+
+				pc->PicocCallMain(argc - ParamCount, &argv[ParamCount]);
+			}
+		}
+		catch (std::exception &){
+		}
+		fflush(stdout);
+		Template.TemplateRecycle(pc);
+	}
+}
+
 int main(int argcc, char **argvc)
 {
 	try{
@@ -24,14 +68,30 @@ int main(int argcc, char **argvc)
 		{
 			printf("Format: picoc <csource1.c>... [- <arg1>...]    : run a program (calls main() to start it)\n"
 				"        picoc -s <csource1.c>... [- <arg1>...] : script mode - runs the program without calling main()\n"
-				"        picoc -i                               : interactive mode\n");
+				"        picoc -i                               : interactive mode\n"
+				"        picoc -r <csource1.c>... [- <arg1>...] : run the program twice, resetting the interpreter in between\n"
+				"        picoc -z                               : report the sizes of the interpreter's structures\n");
 			exit(1);
 		}
+		if (strcmp(argvc[1], "-z") == 0)
+		{
+			printf("struct Value: %d\n", (int)sizeof(struct Value));
+			printf("struct ValueType: %d\n", (int)sizeof(struct ValueType));
+			printf("struct TableEntry: %d\n", (int)sizeof(struct TableEntry));
+			return 0;
+		}
+		if (strcmp(argvc[1], "-r") == 0)
+		{
+			PicocRunTwice(argcc, argvc, StackSize);
+			return 0;
+		}
 		for (int i = 0; i < 1 ; ++i){ // for test
 			int ParamCount = 1;
 			int argc = argcc;
 			char **argv = argvc;
-			Picoc pc(StackSize);
+			Picoc pc(StackSize, 0, getenv("HUGEPAGES") != NULL && atoi(getenv("HUGEPAGES")) != 0);
+
+			pc.PicocSetQuota(PicocQuotaFromEnv());
 
 			if (strcmp(argv[ParamCount], "-s") == 0 || strcmp(argv[ParamCount], "-m") == 0)
 			{
@@ -27,6 +27,7 @@ void Picoc::PicocInitialise( int StackSize)
 #endif
     PlatformLibraryInit();
     DebugInit();
+    PicocSetResetPoint();
 }
 
 /* free memory */
@@ -43,6 +44,114 @@ void Picoc::PicocCleanup()
     PlatformCleanup();
 }
 
+/* make the instance's current state the one Reset() goes back to, including what its variables hold. 
+ * PicocInitialise() sets one - set it again after including the headers every program's going to want. 
+ * call it between programs */
+void Picoc::PicocSetResetPoint()
+{
+	Picoc *pc = this;
+    pc->GlobalTable.TableSeal();
+    pc->StringLiteralTable.TableSeal();
+    pc->ResetTokens = pc->CleanupTokenList.size();
+    TypeSeal();
+    HeapSeal();
+    pc->StringTable.InternerSeal();
+}
+
+/* take the instance back to its reset point, which costs far less than making a new one. works 
+ * whether the last program finished or failed. the variables the reset point had get back the values 
+ * they had then. returns FALSE if the program undefined something the reset point had - the instance 
+ * can't go back then and should be thrown away */
+bool Picoc::Reset()
+{
+	Picoc *pc = this;
+    auto FreeEntry = [](Picoc *pc, struct TableEntry *Entry) {
+        pc->VariableFree(Entry->p.v.ValInValueEntry); Entry->freeValueEntryVal = 0;
+    };
+    
+    /* unwind any calls a failed program left behind. their locals are on the stack, which goes back below */
+    while (TopStackFrame() != nullptr)
+        popStackFrame();
+    
+    pc->ExpressionDepth = 0;
+    pc->ReturnSlot = nullptr;
+    pc->StrtokNext = nullptr;
+    pc->PicocExitValue = 0;
+    LexInteractiveClear(nullptr);
+    LexTokenCacheClear();
+    
+    /* the program's definitions, then the tokens their functions ran from */
+    if (!pc->GlobalTable.TableRewind(pc, FreeEntry) || !pc->StringLiteralTable.TableRewind(pc, FreeEntry))
+        return FALSE;
+    
+    while (pc->CleanupTokenList.size() > pc->ResetTokens)
+    {
+        struct CleanupTokenNode First = pc->CleanupTokenList.front();
+        
+        HeapFreeMem(First.Tokens);
+        if (First.SourceText != NULL)
+            HeapFreeMem((void *)First.SourceText);
+        
+        pc->CleanupTokenList.pop_front();
+    }
+    
+    TypeRewind();
+    HeapRewind();
+    DebugInit();
+    
+    /* last, since everything above could have been using the program's strings */
+    pc->StringTable.InternerRewind();
+    return TRUE;
+}
+
+/* get an instance at the template's reset point - a recycled one if there is one. 
+ * give it back with TemplateRecycle() or delete it */
+Picoc *PicocTemplate::TemplateClone()
+{
+    Picoc *pc;
+    
+    {
+        std::lock_guard<std::mutex> Lock(IdleLock_);
+        if (!Idle_.empty())
+        {
+            pc = Idle_.back();
+            Idle_.pop_back();
+            return pc;
+        }
+    }
+    
+    pc = new Picoc(StackSize_);
+    try
+    {
+        if (Prepare_ != nullptr)
+            (*Prepare_)(pc);
+    }
+    catch (...)
+    {
+        delete pc;
+        throw;
+    }
+    
+    pc->PicocSetResetPoint();
+    return pc;
+}
+
+/* take back an instance from TemplateClone() once its program's done with it */
+void PicocTemplate::TemplateRecycle(Picoc *pc)
+{
+    if (pc->Reset())
+    {
+        std::lock_guard<std::mutex> Lock(IdleLock_);
+        if (Idle_.size() < MaxIdle_)
+        {
+            Idle_.push_back(pc);
+            return;
+        }
+    }
+    
+    delete pc;
+}
+
 /* platform-dependent code for running programs */
 #if defined(UNIX_HOST) || defined(WIN32)
 
@@ -177,6 +286,17 @@ void ParseState::ProgramFail(const char *Message, ...)
 	Parser->pc->PlatformExit(1, Message);
 }
 
+/* exit because a stack allocation didn't fit */
+void ParseState::ProgramFailStack()
+{
+	struct ParseState *Parser = this;
+#ifdef USE_MALLOC_STACK
+	if (Parser->pc->HeapStackOverQuota)
+		Parser->ProgramFail( "stack quota of %d bytes exceeded", (int)Parser->pc->Quota.StackBytes);
+#endif
+	Parser->ProgramFail( "out of memory");
+}
+
 /* exit with a message, when we're not parsing a program */
 void Picoc::ProgramFailNoParser( const char *Message, ...)
 {
@@ -36,6 +36,7 @@
 #ifdef UNIX_HOST
 # define USE_MALLOC_STACK                   /* stack is allocated using malloc() */
 # define USE_MALLOC_HEAP                    /* heap is allocated using malloc() */
+# define USE_MMAP_STACK                     /* stacks are reserved address space, committed as they grow */
 # include <stdio.h>
 # include <stdlib.h>
 # include <ctype.h>
@@ -62,6 +63,7 @@ extern jmp_buf ExitBuf;
 # ifdef WIN32
 #  define USE_MALLOC_STACK                   /* stack is allocated using malloc() */
 #  define USE_MALLOC_HEAP                    /* heap is allocated using malloc() */
+#  define USE_MMAP_STACK                     /* stacks are reserved address space, committed as they grow */
 #  include <stdio.h>
 #  include <stdlib.h>
 #  include <ctype.h>
@@ -49,7 +49,7 @@ char *Picoc::PlatformReadFile( const char *FileName)
     if (stat(FileName, &FileInfo))
         ProgramFailNoParser( "can't read file %s\n", FileName);
     
-	ReadText = static_cast<char*>(malloc(FileInfo.st_size + 1));
+	ReadText = static_cast<char*>(HeapAllocMem(FileInfo.st_size + 1));
     if (ReadText == NULL)
         ProgramFailNoParser("out of memory\n");
         
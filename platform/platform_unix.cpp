@@ -16,7 +16,7 @@ Picoc *break_pc = NULL;
 
 static void BreakHandler(int Signal)
 {
-    break_pc->DebugManualBreak = TRUE;
+    break_pc->DebugRequestBreak();
 }
 
 void PlatformInit(Picoc *pc)
@@ -90,7 +90,7 @@ char *PlatformReadFile(Picoc *pc, const char *FileName)
     if (stat(FileName, &FileInfo))
         ProgramFailNoParser(pc, "can't read file %s\n", FileName);
     
-    ReadText = malloc(FileInfo.st_size + 1);
+    ReadText = HeapAllocMem(pc, FileInfo.st_size + 1);
     if (ReadText == NULL)
         ProgramFailNoParser(pc, "out of memory\n");
         
@@ -2,8 +2,6 @@
  * and the shared string table. */
  
 #include "interpreter.h"
-// for std::find_if
-#include <algorithm>
 
 /* initialise the shared string system */
 void Picoc::TableInit()
@@ -12,39 +10,275 @@ void Picoc::TableInit()
 	pc->StrEmpty = TableStrRegister( "");
 }
 
-/* hash function for strings */
+/* hash function for strings (FNV-1a) */
 static unsigned int TableHash(const char *Key, int Len)
 {
-    unsigned int Hash = Len;
-    int Offset;
+    unsigned int Hash = 2166136261u;
     int Count;
     
-    for (Count = 0, Offset = 8; Count < Len; Count++, Offset+=7)
+    for (Count = 0; Count < Len; Count++)
     {
-        if (Offset > sizeof(unsigned int) * 8 - 7)
-            Offset -= sizeof(unsigned int) * 8 - 6;
-            
-        Hash ^= *Key++ << Offset;
+        Hash ^= (unsigned char)*Key++;
+        Hash *= 16777619u;
     }
     
     return Hash;
 }
 
+/* hash function for key pointers */
+static size_t TableHashKey(const char *Key)
+{
+    uintptr_t Hash = (uintptr_t)Key;
+    
+    Hash ^= Hash >> 16;
+    Hash *= 0x45d9f3b;
+    Hash ^= Hash >> 16;
+    return (size_t)Hash;
+}
+
+/* rebuild the index with at least MinSlots slots, compacting out deleted entries */
+void Table::TableRehash(size_t MinSlots)
+{
+    size_t NumSlots = 16;
+    
+    if (Deleted_ > 0)
+    {
+        size_t To = 0;
+        for (size_t From = 0; From < hashTable_.size(); From++)
+        {
+            if (!hashTable_[From].Deleted)
+            {
+                if (To != From)
+                    hashTable_[To] = hashTable_[From];
+                To++;
+            }
+        }
+        hashTable_.resize(To);
+        Deleted_ = 0;
+    }
+    
+    while (NumSlots < MinSlots)
+        NumSlots <<= 1;
+    
+    Slots_.assign(NumSlots, -1);
+    for (size_t Count = 0; Count < hashTable_.size(); Count++)
+    {
+        size_t Slot = TableHashKey(hashTable_[Count].p.v.Key) & (NumSlots - 1);
+        while (Slots_[Slot] != -1)
+            Slot = (Slot + 1) & (NumSlots - 1);
+        
+        Slots_[Slot] = (int)Count;
+    }
+}
+
+/* append a new entry for this key and index it. the entry is returned for the caller to fill in */
+struct TableEntry *Table::TableInsert(const char *Key)
+{
+    size_t Slot;
+    
+    /* keep the index no more than 3/4 full, counting tombstones */
+    if ((hashTable_.size() + 1) * 4 > Slots_.size() * 3)
+        TableRehash((hashTable_.size() - Deleted_ + 1) * 2);
+    
+    Slot = TableHashKey(Key) & (Slots_.size() - 1);
+    while (Slots_[Slot] >= 0)
+        Slot = (Slot + 1) & (Slots_.size() - 1);
+    
+    Slots_[Slot] = (int)hashTable_.size();
+    hashTable_.emplace_back();
+    hashTable_.back().p.v.Key = Key;
+    
+    return &hashTable_.back();
+}
+
+/* remove an entry from the index and mark it deleted */
+void Table::TableRemove(size_t EntryNo)
+{
+    size_t Slot = TableHashKey(hashTable_[EntryNo].p.v.Key) & (Slots_.size() - 1);
+    while (Slots_[Slot] != (int)EntryNo)
+        Slot = (Slot + 1) & (Slots_.size() - 1);
+    
+    const char *Key = hashTable_[EntryNo].p.v.Key;
+    
+    Slots_[Slot] = -2;
+    hashTable_[EntryNo].Deleted = TRUE;
+    Deleted_++;
+    if (EntryNo < Sealed_)
+        SealBroken_ = true;
+    
+    /* compact once deleted entries make up half the table */
+    if (Deleted_ * 2 > hashTable_.size())
+        TableRehash(Slots_.size());
+    
+    TableRebind(Key);
+}
+
+/* bring a key's binding cell, if it has one, up to date */
+void Table::TableRebind(const char *Key)
+{
+    if (!Bindings_.empty())
+    {
+        auto Cell = Bindings_.find(Key);
+        if (Cell != Bindings_.end())
+        {
+            struct TableEntry *Entry = TableSearch(Key);
+            Cell->second = (Entry == nullptr) ? nullptr : Entry->p.v.ValInValueEntry;
+        }
+    }
+}
+
+/* get the binding cell for a key, making it if it's new. the cell's address doesn't change until the table is freed */
+struct Value **Table::TableBind(const char *Key)
+{
+    auto Cell = Bindings_.find(Key);
+    
+    if (Cell == Bindings_.end())
+    {
+        struct TableEntry *Entry = TableSearch(Key);
+        Cell = Bindings_.emplace(Key, (Entry == nullptr) ? nullptr : Entry->p.v.ValInValueEntry).first;
+    }
+    
+    return &Cell->second;
+}
+
+/* remember the entries there are now. compacting first means they're exactly the first Sealed_ entries, 
+ * and they stay that way as long as none of them is deleted */
+void Table::TableSeal()
+{
+    if (Deleted_ > 0)
+        TableRehash(Slots_.size());
+    
+    Sealed_ = hashTable_.size();
+    SealBroken_ = false;
+}
+
+/* go back to the entries there were at TableSeal(), calling func on each newer entry, newest first. 
+ * returns false without changing anything if one of the sealed entries has been deleted since */
+bool Table::TableRewind(Picoc *pc, const std::function< void(Picoc*, struct TableEntry *)> &func)
+{
+    if (SealBroken_)
+        return false;
+    
+    for (size_t Count = hashTable_.size(); Count-- > Sealed_; )
+    {
+        if (!hashTable_[Count].Deleted)
+            func(pc, &hashTable_[Count]);
+    }
+    
+    hashTable_.resize(Sealed_);
+    Deleted_ = 0;
+    ScopeStack_.clear();
+    Bindings_.clear();          /* nothing can be holding a cell - the caches that do are cleared first */
+    TableRehash(Slots_.size());
+    return true;
+}
 
 /* check a hash table entry for a key */
 struct TableEntry *Table::TableSearch(const char *Key)
 {
-	if (!hashTable_.empty()){
-		auto it = std::find_if(hashTable_.begin(), hashTable_.end(), [Key](struct TableEntry *Entry){return Entry->p.v.Key == Key; });
-		if (it != hashTable_.end()){
-			return *it; // found
-		}
-	}
-	return nullptr; // didn't find it in the container
+    size_t Slot;
+    
+    if (Slots_.empty())
+        return nullptr;
+    
+    for (Slot = TableHashKey(Key) & (Slots_.size() - 1); Slots_[Slot] != -1; Slot = (Slot + 1) & (Slots_.size() - 1))
+    {
+        if (Slots_[Slot] >= 0 && hashTable_[Slots_[Slot]].p.v.Key == Key && !hashTable_[Slots_[Slot]].Hidden)
+            return &hashTable_[Slots_[Slot]];   /* found */
+    }
+    
+    return nullptr; /* didn't find it in the chain */
+}
+
+/* add an entry that's already filled in. duplicate keys are allowed */
+void Table::TableSet(const char *Key, const struct TableEntry &NewEntry)
+{
+    struct TableEntry *Entry = TableInsert(Key);
+    *Entry = NewEntry;
+    Entry->p.v.Key = Key;
+    Entry->Deleted = FALSE;
+    Entry->Hidden = FALSE;
+    TableRebind(Key);
+}
+
+/* get the current depth of the scope stack, to be passed to TableScopeEnd() when the block ends */
+int Table::TableScopeMark()
+{
+    return (int)ScopeStack_.size();
+}
+
+/* note that a block has made this entry visible */
+void Table::TableScopeAdd(const char *Key, struct Value *Val)
+{
+    ScopeStack_.emplace_back(Key, Val);
+}
+
+/* note that a block has made a frame slot's value visible. slots aren't in the table, so it's hidden by its value alone */
+void Table::TableScopeAddSlot(struct Value *Val)
+{
+    ScopeStack_.emplace_back(nullptr, Val);
+}
+
+/* hide everything made visible since the scope stack was at Mark */
+void Table::TableScopeEnd(int Mark)
+{
+    while ((int)ScopeStack_.size() > Mark)
+    {
+        struct TableEntry *Entry = (ScopeStack_.back().first == nullptr) ? nullptr : TableSearch(ScopeStack_.back().first);
+        if (ScopeStack_.back().first == nullptr)
+        {
+            ScopeStack_.back().second->OutOfScope = TRUE;
+        }
+        else if (Entry != nullptr && Entry->p.v.ValInValueEntry == ScopeStack_.back().second)
+        {
+            Entry->Hidden = TRUE;
+            Entry->p.v.ValInValueEntry->OutOfScope = TRUE;
+            TableRebind(ScopeStack_.back().first);
+        }
+        
+        ScopeStack_.pop_back();
+    }
 }
 
- void Table::TableSet(const char *Key, struct TableEntry* newEntry){
-	hashTable_.push_front(newEntry);
+/* bring back a hidden entry which was declared at the given position. returns its value, or NULL if there isn't one */
+struct Value *Table::TableReveal(const char *Key, const char *DeclFileName, int DeclLine, int DeclColumn)
+{
+    size_t Slot;
+    
+    if (Slots_.empty())
+        return nullptr;
+    
+    for (Slot = TableHashKey(Key) & (Slots_.size() - 1); Slots_[Slot] != -1; Slot = (Slot + 1) & (Slots_.size() - 1))
+    {
+        struct TableEntry *Entry = Slots_[Slot] >= 0 ? &hashTable_[Slots_[Slot]] : nullptr;
+        if (Entry != nullptr && Entry->p.v.Key == Key && Entry->Hidden && Entry->DeclFileName == DeclFileName && 
+                Entry->DeclLine == DeclLine && Entry->DeclColumn == DeclColumn)
+        {
+            Entry->Hidden = FALSE;
+            Entry->p.v.ValInValueEntry->OutOfScope = FALSE;
+            TableRebind(Key);
+            return Entry->p.v.ValInValueEntry;
+        }
+    }
+    
+    return nullptr;
+}
+
+/* check if there's an out of scope entry with this key */
+bool Table::TableIsHidden(const char *Key)
+{
+    size_t Slot;
+    
+    if (Slots_.empty())
+        return false;
+    
+    for (Slot = TableHashKey(Key) & (Slots_.size() - 1); Slots_[Slot] != -1; Slot = (Slot + 1) & (Slots_.size() - 1))
+    {
+        if (Slots_[Slot] >= 0 && hashTable_[Slots_[Slot]].p.v.Key == Key && hashTable_[Slots_[Slot]].Hidden)
+            return true;
+    }
+    
+    return false;
 }
 
 
@@ -54,14 +288,13 @@ bool Table::TableSet(const char *Key, struct Value *Val, const char *DeclFileNam
 
 	if (FoundEntry == nullptr)
 	{   /* add it to the table */
-		struct TableEntry *NewEntry = new struct TableEntry; 
+		struct TableEntry *NewEntry = TableInsert(Key);
 		NewEntry->DeclFileName = DeclFileName;
 		NewEntry->DeclLine = DeclLine;
 		NewEntry->DeclColumn = DeclColumn;
-		NewEntry->p.v.Key = Key;
 		NewEntry->p.v.ValInValueEntry = Val;
 		NewEntry->freeValueEntryVal = 1;
-		hashTable_.push_front(NewEntry);
+		TableRebind(Key);
 		return true;
 	}
 	return true;
@@ -73,28 +306,38 @@ bool Table::TableSet(const char *Key, struct ValueAbs *Val, const char *DeclFile
 
 	if (FoundEntry == nullptr)
 	{   /* add it to the table */
-		struct TableEntry *NewEntry = new struct TableEntry;
+		struct TableEntry *NewEntry = TableInsert(Key);
 		NewEntry->DeclFileName = DeclFileName;
 		NewEntry->DeclLine = DeclLine;
 		NewEntry->DeclColumn = DeclColumn;
-		NewEntry->p.va.Key = Key;
 		NewEntry->p.va.ValInValueEntry = Val;
 		NewEntry->freeValueEntryVal = 1;
-		hashTable_.push_front(NewEntry);
+		TableRebind(Key);
 		return true;
 	}
 	return true;
 }
+/* if this is a definition in a user-defined function's local table note the name in the function's layout, 
+ * so globals bound from inside the function know they may now be shadowed */
+void Picoc::TableNoteLocalName(struct Table *Tbl, const char *Key)
+{
+	struct StackFrame *Frame = TopStackFrame();
+	if (Frame != nullptr && Frame->Layout != nullptr && Tbl == Frame->LocalTable.get())
+		Frame->Layout->Names.insert(Key);
+}
+
 /* set an identifier to a value. returns FALSE if it already exists. 
  * Key must be a shared string from TableStrRegister() */
 int Picoc::TableSet(struct Table *Tbl, const char *Key, struct Value *Val, const char *DeclFileName, int DeclLine, int DeclColumn)
 {
+	TableNoteLocalName(Tbl, Key);
 	return Tbl->TableSet(Key, Val, DeclFileName, DeclLine, DeclColumn);
 }
 /* set an identifier to a value. returns FALSE if it already exists.
 * Key must be a shared string from TableStrRegister() */
 int Picoc::TableSet(struct Table *Tbl, const char *Key, struct ValueAbs *Val, const char *DeclFileName, int DeclLine, int DeclColumn)
 {
+	TableNoteLocalName(Tbl, Key);
 	return Tbl->TableSet(Key, Val, DeclFileName, DeclLine, DeclColumn);
 }
 
@@ -150,12 +393,11 @@ struct Value *Table::TableDelete(const char *Key)
 {
 	struct Table *Tbl = this;
 	struct Value *retValue = nullptr;
-	auto it = std::find_if(hashTable_.begin(), hashTable_.end(), [Key](struct TableEntry *Entry){return Entry->p.v.Key == Key; });
-	if (it != Tbl->hashTable_.end()){
-		retValue = (*it)->p.v.ValInValueEntry;
-		(*it)->freeValueEntryVal = 0;
-		delete *it;
-		Tbl->hashTable_.erase(it);
+	struct TableEntry *FoundEntry = Tbl->TableSearch(Key);
+	if (FoundEntry != nullptr){
+		retValue = FoundEntry->p.v.ValInValueEntry;
+		FoundEntry->freeValueEntryVal = 0;
+		TableRemove(FoundEntry - &hashTable_[0]);
 	}
 	return retValue;
 }
@@ -168,48 +410,119 @@ struct Value *Picoc::TableDelete( struct Table *Tbl, const char *Key)
 	return Val;
 }
 
-/* check a hash table entry for an identifier */
-struct TableEntry *Table::TableSearchIdentifier(const std::string &Key)
+/* allocate some space for a string in the interner's arena */
+char *StringInterner::InternerAlloc(int Size)
 {
-	struct Table *Tbl = this;
-	auto it = Tbl->hashTable_.begin();
-	for(auto itEnd = Tbl->hashTable_.end(); it != itEnd; ++it){
-		if ((*it)->identifier_.compare(Key) == 0){
-			return (*it);
-		}
-	}
-	return nullptr;
+    char *NewMem;
+    
+    if ((size_t)Size > BlockLeft_)
+    {
+        size_t BlockSize = Size > INTERNER_BLOCK_SIZE ? Size : INTERNER_BLOCK_SIZE;
+        Blocks_.push_back(InternBlock{ new char[BlockSize], BlockSize });
+        BlockPos_ = Blocks_.back().Mem;
+        BlockLeft_ = BlockSize;
+    }
+    
+    NewMem = BlockPos_;
+    BlockPos_ += Size;
+    BlockLeft_ -= Size;
+    return NewMem;
+}
+
+/* rebuild the index with NumSlots slots */
+void StringInterner::InternerRehash(size_t NumSlots)
+{
+    std::vector<struct InternSlot> OldSlots(NumSlots, InternSlot{ 0, 0, nullptr });
+    
+    OldSlots.swap(Slots_);
+    for (auto it = OldSlots.begin(); it != OldSlots.end(); ++it)
+    {
+        if (it->Str != nullptr)
+        {
+            size_t Slot = it->Hash & (NumSlots - 1);
+            while (Slots_[Slot].Str != nullptr)
+                Slot = (Slot + 1) & (NumSlots - 1);
+            
+            Slots_[Slot] = *it;
+        }
+    }
 }
-/** set an identifier and return the identifier. share if possible */
-const char *Table::TableSetIdentifier( const char *Ident, int IdentLen){
-	struct Table *Tbl = this;
-	std::string Key(Ident, IdentLen);
-	struct TableEntry *FoundEntry = Tbl->TableSearchIdentifier(Key);
 
-	if (FoundEntry != nullptr)
-		return FoundEntry->identifier_.c_str(); // &FoundEntry->p.Key[0];
-	else
-	{   /* add it to the table - we economise by not allocating the whole structure here */
-		struct TableEntry *NewEntry = new struct TableEntry;
-		NewEntry->identifier_ = Key;
+/* register a string, returning the shared copy of it */
+const char *StringInterner::InternerRegister(const char *Str, int Len)
+{
+    unsigned int Hash = TableHash(Str, Len);
+    size_t Slot;
+    char *NewStr;
+    
+    if ((Count_ + 1) * 4 > Slots_.size() * 3)
+        InternerRehash(Slots_.empty() ? 256 : Slots_.size() * 2);
+    
+    for (Slot = Hash & (Slots_.size() - 1); Slots_[Slot].Str != nullptr; Slot = (Slot + 1) & (Slots_.size() - 1))
+    {
+        if (Slots_[Slot].Hash == Hash && Slots_[Slot].Len == Len && memcmp(Slots_[Slot].Str, Str, Len) == 0)
+            return Slots_[Slot].Str;   /* found */
+    }
+    
+    /* add it to the arena */
+    NewStr = InternerAlloc(Len + 1);
+    memcpy(NewStr, Str, Len);
+    NewStr[Len] = '\0';
+    Slots_[Slot] = InternSlot{ Hash, Len, NewStr };
+    Count_++;
+    
+    return NewStr;
+}
 
-		hashTable_.push_front(NewEntry);
+/* free all the registered strings */
+void StringInterner::InternerFree()
+{
+    for (auto it = Blocks_.begin(); it != Blocks_.end(); ++it)
+        delete[] it->Mem;
+    
+    Blocks_.clear();
+    Slots_.clear();
+    SealSlots_.clear();
+    SealCount_ = 0;
+    SealBlocks_ = 0;
+    Count_ = 0;
+    BlockPos_ = nullptr;
+    BlockLeft_ = 0;
+}
 
-		return NewEntry->identifier_.c_str(); // &NewEntry->p.Key[0];
-	}
+/* remember what's registered now, for InternerRewind() */
+void StringInterner::InternerSeal()
+{
+    SealSlots_ = Slots_;
+    SealCount_ = Count_;
+    SealBlocks_ = Blocks_.size();
+    SealPos_ = BlockPos_;
+    SealLeft_ = BlockLeft_;
 }
-/** set an identifier and return the identifier. share if possible */
-const char *Picoc::TableSetIdentifier( struct Table *Tbl, const char *Ident, int IdentLen)
+
+/* forget every string registered since InternerSeal(). nothing may still be using them */
+void StringInterner::InternerRewind()
 {
-	Picoc *pc = this;
-	return Tbl->TableSetIdentifier(Ident, IdentLen);
+    if (Count_ == SealCount_)
+        return;
+    
+    while (Blocks_.size() > SealBlocks_)
+    {
+        delete[] Blocks_.back().Mem;
+        Blocks_.pop_back();
+    }
+    
+    Slots_ = SealSlots_;
+    Count_ = SealCount_;
+    BlockPos_ = SealPos_;
+    BlockLeft_ = SealLeft_;
 }
 
 /** register a string in the shared string store */
 const char *Picoc::TableStrRegister2( const char *Str, int Len)
 {
 	Picoc *pc = this;
-    return TableSetIdentifier( &pc->StringTable, Str, Len);
+    return pc->StringTable.InternerRegister(Str, Len);
 }
 
 const char *Picoc::TableStrRegister( const char *Str)
@@ -220,70 +533,55 @@ const char *Picoc::TableStrRegister( const char *Str)
 
 /* free all TableEntries */
 void Table::TableFree(){
-	if (!hashTable_.empty()){
-		for (auto it = hashTable_.begin(); it != hashTable_.end(); ++it){
-			delete (*it);
-		};
-	}
 	hashTable_.clear();
+	Slots_.clear();
+	Deleted_ = 0;
+	ScopeStack_.clear();
+	for (auto it = Bindings_.begin(); it != Bindings_.end(); ++it)
+		it->second = nullptr;
+	Sealed_ = 0;
+	SealBroken_ = false;
 }
 
-/* free all TableEntries */
+/* free all TableEntries, newest first, calling func on each of them */
 void Table::TableFree(Picoc *pc, void(func)(Picoc*, struct TableEntry *)){
 	if (!hashTable_.empty()){
-		for (auto it = hashTable_.begin(); it != hashTable_.end(); ++it){
+		for (auto it = hashTable_.rbegin(); it != hashTable_.rend(); ++it){
 			assert(pc);
-			assert(*it);
-			func(pc, *it);
-			delete *it;
+			if (!it->Deleted)
+				func(pc, &(*it));
 		};
-		hashTable_.clear();
+		TableFree();
 	}
 }
 
 void Table::TableForEach(Picoc *pc, const std::function< void (Picoc*, struct TableEntry *)> &func){
-	if (!hashTable_.empty()){
-		for (auto it = hashTable_.begin(); it != hashTable_.end(); ++it){
-			func(pc, *it);
-		};
-	}
+	for (auto it = hashTable_.rbegin(); it != hashTable_.rend(); ++it){
+		if (!it->Deleted)
+			func(pc, &(*it));
+	};
 }
 
 
 bool Table::TableFindIf(Picoc *pc, const std::function< bool (Picoc*, struct TableEntry *)> &func){
-	int Count = 0;
-	if (!hashTable_.empty()){
-		for (auto it = hashTable_.begin(); it != hashTable_.end(); ++it){
-			if (func(pc, *it)) return true;
-		};
-	}
-	return false;
+	return TableFindEntryIf(pc, func) != nullptr;
 }
 
 struct TableEntry *Table::TableFindEntryIf(Picoc *pc, const std::function< bool(Picoc*, struct TableEntry *)> &func){
-	int Count = 0;
-	if (!hashTable_.empty()){
-		for (auto it = hashTable_.begin(); it != hashTable_.end(); ++it){
-			if (func(pc, *it)) return *it;
-		};
-	}
+	for (auto it = hashTable_.rbegin(); it != hashTable_.rend(); ++it){
+		if (!it->Deleted && func(pc, &(*it))) return &(*it);
+	};
 	return nullptr;
 }
 
+/* remove the first (newest) entry func matches */
 bool Table::TableDeleteIf(Picoc *pc, const std::function< bool(Picoc*, struct TableEntry *)> &func){
-	int Count = 0;
-	if (!hashTable_.empty()){
-		for (auto it = hashTable_.begin(); it != hashTable_.end(); ){
-			if (func(pc, *it)) {
-				delete *it;
-				it=hashTable_.erase(it); // error here ?
-				return true;
-			}
-			else {
-				++it;
-			}
-		};
-	}
+	for (size_t Count = hashTable_.size(); Count-- > 0; ){
+		if (!hashTable_[Count].Deleted && func(pc, &hashTable_[Count])) {
+			TableRemove(Count);
+			return true;
+		}
+	};
 	return false;
 }
 
@@ -0,0 +1,46 @@
+#include <stdio.h>
+
+int main()
+{
+    int a = 3;
+    int *p = &a;
+    int *q = NULL;
+    double d = 0.5;
+    char c = 0;
+    int n;
+
+    if (p)
+        printf("p is set\n");
+
+    if (q)
+        printf("q is set\n");
+    else
+        printf("q is null\n");
+
+    if (d)
+        printf("d is non-zero\n");
+
+    if (!c)
+        printf("c is zero\n");
+
+    n = 0;
+    while (d < 4.0)
+    {
+        d = d * 2;
+        n++;
+    }
+    printf("%d\n", n);
+
+    n = 0;
+    do
+        n++;
+    while (n < a);
+    printf("%d\n", n);
+
+    for (n = 0; p; n++)
+        if (n == 2)
+            p = NULL;
+    printf("%d\n", n);
+
+    return 0;
+}
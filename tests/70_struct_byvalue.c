@@ -0,0 +1,83 @@
+#include <stdio.h>
+
+struct vec
+{
+    double x;
+    double y;
+    double z;
+};
+
+struct big
+{
+    int a[100];
+};
+
+struct vec vmake(double x, double y, double z)
+{
+    struct vec v;
+    v.x = x;
+    v.y = y;
+    v.z = z;
+    return v;
+}
+
+struct vec vadd(struct vec a, struct vec b)
+{
+    return vmake(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+struct vec vscale(struct vec a, double k)
+{
+    a.x = a.x * k;
+    a.y = a.y * k;
+    a.z = a.z * k;
+    return a;
+}
+
+struct vec chain(struct vec a)
+{
+    return vadd(vscale(a, 2.0), vadd(a, a));
+}
+
+struct vec pick(struct vec a, struct vec b, int which)
+{
+    if (which)
+        return a;
+
+    return vadd(b, b);
+}
+
+int sumbig(struct big b)
+{
+    int i;
+    int s = 0;
+
+    for (i = 0; i < 100; i++)
+        s += b.a[i];
+
+    b.a[0] = 999;
+    return s;
+}
+
+int main()
+{
+    struct vec a = vmake(1, 2, 3);
+    struct vec c = chain(a);
+    struct big bg;
+    int i;
+
+    for (i = 0; i < 100; i++)
+        bg.a[i] = i;
+
+    printf("%f %f %f\n", c.x, c.y, c.z);
+    printf("%d %d\n", sumbig(bg), bg.a[0]);
+
+    c = pick(a, c, 0);
+    printf("%f\n", c.x);
+    c = pick(a, c, 1);
+    printf("%f\n", c.x);
+    a = vadd(a, a);
+    printf("%f\n", a.z);
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main()
+{
+    int *a;
+    int *z;
+    char *s;
+    char *big;
+    char *leak;
+    int i;
+    int sum;
+
+    a = malloc(10 * sizeof(int));
+    for (i = 0; i < 10; i++)
+        a[i] = i * i;
+
+    /* small growth, then past the size classes */
+    a = realloc(a, 20 * sizeof(int));
+    for (i = 10; i < 20; i++)
+        a[i] = i * i;
+
+    a = realloc(a, 1000 * sizeof(int));
+    for (i = 20; i < 1000; i++)
+        a[i] = i;
+
+    sum = 0;
+    for (i = 0; i < 20; i++)
+        sum += a[i];
+
+    printf("%d %d\n", sum, a[999]);
+
+    /* and back down again */
+    a = realloc(a, 5 * sizeof(int));
+    printf("%d %d\n", a[2], a[4]);
+    free(a);
+
+    z = calloc(300, sizeof(int));
+    sum = 0;
+    for (i = 0; i < 300; i++)
+        sum += z[i];
+
+    printf("%d\n", sum);
+    free(z);
+
+    s = realloc(NULL, 6);
+    strcpy(s, "hello");
+    s = realloc(s, 12);
+    strcat(s, " world");
+    printf("%s\n", s);
+    free(s);
+
+    big = malloc(100000);
+    big[99999] = 'x';
+    printf("%c\n", big[99999]);
+    free(big);
+
+    free(NULL);
+
+    /* left for the interpreter to clean up */
+    leak = malloc(5000);
+    leak[0] = 'y';
+    leak = malloc(50);
+    leak[0] = 'z';
+    printf("%c\n", leak[0]);
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int g = 42;
+int list[4] = { 1, 2, 3, 4 };
+
+struct Name
+{
+    char buf[8];
+};
+
+struct Name name()
+{
+    struct Name n;
+    
+    strcpy(n.buf, "fred");
+    return n;
+}
+
+int main()
+{
+    int *p = &g;
+    int *q = list;
+    int *m = malloc(4 * sizeof(int));
+    int local = 5;
+    int i;
+    int sum = 0;
+
+    m[3] = 7;
+    printf("%d %d %d %d\n", *p, q[3], m[3], *&local);
+    free(m);
+
+    for (i = 0; i < 4; i++)
+        sum += list[i];
+
+    printf("%d\n", sum);
+
+    /* a struct returned from a function is the program's own too */
+    printf("%s\n", name().buf);
+
+    /* indexing the array itself is bounded too, not just through a pointer */
+    list[100000000] = 1;
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include <stdio.h>
+#include <string.h>
+
+char name[16];
+
+int main()
+{
+    char buf[8];
+    char *bad;
+
+    strcpy(name, "picoc");
+    strncpy(buf, name, sizeof(buf));
+    printf("%s %d %d\n", buf, strlen(buf), strcmp(buf, name));
+    sprintf(buf, "%d", 1234);
+    printf("%s\n", buf);
+
+    /* the library checks what it's pointed at, just as a dereference does */
+    bad = (char *)4096;
+    strcpy(buf, bad);
+    printf("not reached\n");
+    return 0;
+}
@@ -0,0 +1,15 @@
+#include <stdio.h>
+
+int main()
+{
+    int g = 42;
+    int *p = &g;
+    int *bad;
+
+    printf("%d\n", *p);
+
+    /* nothing the program was given lives down here */
+    bad = (int *)4096;
+    printf("%d\n", *bad);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+/* run with STACKQUOTA set. each call's frame is mostly pad, so it's a call that takes the stack past its quota */
+int deep(int n)
+{
+    char pad[4096];
+
+    pad[0] = n % 100;
+    return deep(n + 1) + pad[0];
+}
+
+int main()
+{
+    printf("recursing\n");
+    printf("%d\n", deep(0));
+    return 0;
+}
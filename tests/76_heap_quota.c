@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* run with HEAPQUOTA set - malloc() fails the program once the blocks reach it */
+int main()
+{
+    char *block;
+    int i;
+
+    for (i = 0; i < 1000; i++)
+    {
+        block = malloc(1000);
+        block[999] = i;
+        if (i % 10 == 0)
+            printf("%d\n", i);
+    }
+
+    printf("done\n");
+    return 0;
+}
@@ -2,6 +2,7 @@
  * for parsing data types. */
  
 #include "interpreter.h"
+#include <algorithm>
 
 
 
@@ -21,6 +22,7 @@ struct ValueType *ParseState::TypeAdd(  struct ValueType *ParentType, enum BaseT
     NewType->OnHeap = LocationOnHeap;
     NewType->Next = ParentType->DerivedTypeList;
     ParentType->DerivedTypeList = NewType;
+    pc->DerivedTypes[DerivedTypeKey{ ParentType, Base, ArraySize, Identifier }] = NewType;
     
     return NewType;
 }
@@ -32,12 +34,11 @@ struct ValueType *ParseState::TypeGetMatching(struct ValueType *ParentType, enum
 	struct ParseState *Parser = this;
     int Sizeof;
     int AlignBytes;
-    struct ValueType *ThisType = ParentType->DerivedTypeList;
-    while (ThisType != nullptr && (ThisType->Base != Base || ThisType->ArraySize != ArraySize || ThisType->IdentifierOfValueType != Identifier))
-        ThisType = ThisType->Next;
+    auto Found = Parser->pc->DerivedTypes.find(DerivedTypeKey{ ParentType, Base, ArraySize, Identifier });
     
-    if (ThisType != nullptr)
+    if (Found != Parser->pc->DerivedTypes.end())
     {
+        struct ValueType *ThisType = Found->second;
         if (AllowDuplicates)
             return ThisType;
         else
@@ -103,6 +104,7 @@ void Picoc::TypeAddBaseType( struct ValueType *TypeNode, enum BaseType Base, int
     TypeNode->OnHeap = LocationOnStack;
     TypeNode->Next = pc->UberType.DerivedTypeList;
     pc->UberType.DerivedTypeList = TypeNode;
+    pc->DerivedTypes[DerivedTypeKey{ &pc->UberType, Base, 0, pc->StrEmpty }] = TypeNode;
 }
 
 /* initialise the type system */
@@ -165,10 +167,7 @@ void Picoc::TypeCleanupNode( struct ValueType *Typ)
         {
             /* if it's a struct or union deallocate all the member values */
             if (SubType->Members != NULL)
-            {
-                VariableTableCleanup( SubType->Members);
 				delete SubType->Members; // obsolete HeapFreeMem( SubType->Members);
-            }
 
             /* free this node */
             HeapFreeMem( SubType);
@@ -179,7 +178,83 @@ void Picoc::TypeCleanupNode( struct ValueType *Typ)
 void Picoc::TypeCleanup()
 {
 	Picoc *pc = this;
+    TypeCacheClear();
     TypeCleanupNode( &pc->UberType);
+    pc->DerivedTypes.clear();
+}
+
+/* remember every type there is now, for TypeRewind() */
+void Picoc::TypeSeal()
+{
+	Picoc *pc = this;
+    pc->ResetTypes.clear();
+    TypeSealNode( &pc->UberType);
+}
+
+void Picoc::TypeSealNode( struct ValueType *Typ)
+{
+	Picoc *pc = this;
+    struct ValueType *SubType;
+    
+    pc->ResetTypes.push_back(TypeSealEntry{ Typ, Typ->DerivedTypeList, Typ->Members, Typ->Sizeof, Typ->AlignBytes });
+    for (SubType = Typ->DerivedTypeList; SubType != NULL; SubType = SubType->Next)
+        TypeSealNode( SubType);
+}
+
+/* get rid of every type made since TypeSeal(). new types are always added at the front of 
+ * their parent's list so they're the ones in front of what the list started with then */
+void Picoc::TypeRewind()
+{
+	Picoc *pc = this;
+    TypeCacheClear();
+    pc->TypeCacheEpoch++;
+    
+    for (auto it = pc->ResetTypes.begin(); it != pc->ResetTypes.end(); ++it)
+    {
+        struct ValueType *Typ = it->Typ;
+        
+        while (Typ->DerivedTypeList != it->DerivedTypeList)
+        {
+            struct ValueType *SubType = Typ->DerivedTypeList;
+            
+            Typ->DerivedTypeList = SubType->Next;
+            TypeFreeNode( SubType);
+        }
+        
+        if (Typ->Members != it->Members)
+        {
+            if (Typ->Members != &pc->NoMembers)
+                delete Typ->Members;
+            
+            Typ->Members = it->Members;
+        }
+        
+        Typ->Sizeof = it->Sizeof;
+        Typ->AlignBytes = it->AlignBytes;
+    }
+}
+
+/* free a type which isn't in its parent's list any more, and everything derived from it */
+void Picoc::TypeFreeNode( struct ValueType *Typ)
+{
+	Picoc *pc = this;
+    struct ValueType *SubType;
+    struct ValueType *NextSubType;
+    auto Found = pc->DerivedTypes.find(DerivedTypeKey{ Typ->FromType, Typ->Base, Typ->ArraySize, Typ->IdentifierOfValueType });
+    
+    for (SubType = Typ->DerivedTypeList; SubType != NULL; SubType = NextSubType)
+    {
+        NextSubType = SubType->Next;
+        TypeFreeNode( SubType);
+    }
+    
+    if (Found != pc->DerivedTypes.end() && Found->second == Typ)
+        pc->DerivedTypes.erase(Found);
+    
+    if (Typ->Members != NULL && Typ->Members != &pc->NoMembers)
+        delete Typ->Members;
+    
+    HeapFreeMem( Typ);
 }
 
 /* parse a struct or union declaration */
@@ -190,7 +265,7 @@ void ParseState::TypeParseStruct(struct ValueType **Typ, int IsStruct)
     struct ValueType *MemberType;
     const char *MemberIdentifier;
     const char *StructIdentifier;
-    struct Value *MemberValue;
+    int MemberOffset;
     enum LexToken Token;
     int AlignBoundary;
     /*obsolete Picoc *pc = Parser->pc; */
@@ -206,6 +281,7 @@ void ParseState::TypeParseStruct(struct ValueType **Typ, int IsStruct)
     {
         static char TempNameBuf[7] = "^s0000";
 		StructIdentifier = pc->PlatformMakeTempName(TempNameBuf);
+        pc->TypeCacheable = FALSE;
     }
 
     *Typ = TypeGetMatching( &Parser->pc->UberType, IsStruct ? TypeStruct : TypeUnion, 0, StructIdentifier, TRUE);
@@ -226,8 +302,9 @@ void ParseState::TypeParseStruct(struct ValueType **Typ, int IsStruct)
     if (pc->TopStackFrame() != NULL)
         Parser->ProgramFail( "struct/union definitions can only be globals");
         
+    pc->TypeCacheable = FALSE;
     Parser->LexGetToken( NULL, TRUE);    
-	(*Typ)->Members = new struct Table;// obsolete static_cast<Table*>(pc->VariableAlloc(Parser, sizeof(struct Table) + STRUCT_TABLE_SIZE * sizeof(struct TableEntry), TRUE));
+	(*Typ)->Members = new struct MemberList;// obsolete static_cast<Table*>(pc->VariableAlloc(Parser, sizeof(struct Table) + STRUCT_TABLE_SIZE * sizeof(struct TableEntry), TRUE));
     // obsolete (*Typ)->Members->HashTable = (struct TableEntry **)((char *)(*Typ)->Members + sizeof(struct Table));
 	// obsolete (*Typ)->Members->TableInitTable((struct TableEntry **)((char *)(*Typ)->Members + sizeof(struct Table)), STRUCT_TABLE_SIZE, TRUE);
 	// obsolete init in the constructor (*Typ)->Members->TableInitTable(&(*Typ)->Members->publicMap );
@@ -237,33 +314,31 @@ void ParseState::TypeParseStruct(struct ValueType **Typ, int IsStruct)
         if (MemberType == NULL || MemberIdentifier == NULL)
             Parser->ProgramFail( "invalid type in struct");
         
-		MemberValue = VariableAllocValueAndData( sizeof(int), FALSE, NULL, LocationOnHeap);
-        MemberValue->TypeOfValue = MemberType;
         if (IsStruct)
         { 
             /* allocate this member's location in the struct */
-            AlignBoundary = MemberValue->TypeOfValue->AlignBytes;
+            AlignBoundary = MemberType->AlignBytes;
             if (((*Typ)->Sizeof & (AlignBoundary-1)) != 0)
                 (*Typ)->Sizeof += AlignBoundary - ((*Typ)->Sizeof & (AlignBoundary-1));
                 
-            MemberValue->setVal<int>(pc, (*Typ)->Sizeof);
-			(*Typ)->Sizeof += MemberValue->TypeSizeValue(TRUE);
+            MemberOffset = (*Typ)->Sizeof;
+			(*Typ)->Sizeof += TypeSize(MemberType, MemberType->ArraySize, TRUE);
         }
         else
         { 
             /* union members always start at 0, make sure it's big enough to hold the largest member */
-            MemberValue->setVal<int>(pc, 0);
-            if (MemberValue->TypeOfValue->Sizeof > (*Typ)->Sizeof)
-				(*Typ)->Sizeof = MemberValue->TypeSizeValue(TRUE);
+            MemberOffset = 0;
+            if (MemberType->Sizeof > (*Typ)->Sizeof)
+				(*Typ)->Sizeof = TypeSize(MemberType, MemberType->ArraySize, TRUE);
         }
 
         /* make sure to align to the size of the largest member's alignment */
-        if ((*Typ)->AlignBytes < MemberValue->TypeOfValue->AlignBytes)
-            (*Typ)->AlignBytes = MemberValue->TypeOfValue->AlignBytes;
+        if ((*Typ)->AlignBytes < MemberType->AlignBytes)
+            (*Typ)->AlignBytes = MemberType->AlignBytes;
         
         /* define it */
-        if (!pc->TableSet( (*Typ)->Members, MemberIdentifier, MemberValue, Parser->FileName, Parser->Line, Parser->CharacterPos))
-            Parser->ProgramFail( "member '%s' already defined", &MemberIdentifier);
+        if (!(*Typ)->Members->MemberAdd(MemberIdentifier, MemberType, MemberOffset))
+            Parser->ProgramFail( "member '%s' already defined", MemberIdentifier);
             
         if (Parser->LexGetToken( NULL, TRUE) != TokenSemicolon)
             Parser->ProgramFail( "semicolon expected");
@@ -278,6 +353,41 @@ void ParseState::TypeParseStruct(struct ValueType **Typ, int IsStruct)
     Parser->LexGetToken( NULL, TRUE);
 }
 
+/* find a member by its identifier, which must be registered. returns NULL if there's no such member */
+struct StructMember *MemberList::MemberFind(const char *Ident)
+{
+    size_t Low = 0;
+    size_t High = ByIdent.size();
+    
+    while (Low < High)
+    {
+        size_t Mid = (Low + High) / 2;
+        if (Members[ByIdent[Mid]].Ident < Ident)
+            Low = Mid + 1;
+        else
+            High = Mid;
+    }
+    
+    if (Low < ByIdent.size() && Members[ByIdent[Low]].Ident == Ident)
+        return &Members[ByIdent[Low]];
+    
+    return NULL;
+}
+
+/* add a member after the existing ones. returns false if there's already a member with this identifier */
+bool MemberList::MemberAdd(const char *Ident, struct ValueType *Typ, int Offset)
+{
+    auto Pos = std::lower_bound(ByIdent.begin(), ByIdent.end(), Ident, 
+        [this](int MemberNo, const char *Key) { return Members[MemberNo].Ident < Key; });
+    
+    if (Pos != ByIdent.end() && Members[*Pos].Ident == Ident)
+        return false;
+    
+    ByIdent.insert(Pos, (int)Members.size());
+    Members.push_back(StructMember{ Ident, Typ, Offset });
+    return true;
+}
+
 /* create a system struct which has no user-visible members */
 struct ValueType *ParseState::TypeCreateOpaqueStruct(const char *StructName, int Size)
 {
@@ -285,7 +395,7 @@ struct ValueType *ParseState::TypeCreateOpaqueStruct(const char *StructName, int
     struct ValueType *Typ = TypeGetMatching( &pc->UberType, TypeStruct, 0, StructName, FALSE);
     
     /* create the (empty) table */
-	Typ->Members = new struct Table; //    static_cast<Table*>(VariableAlloc(Parser, sizeof(struct Table) + STRUCT_TABLE_SIZE * sizeof(struct TableEntry), TRUE));
+	Typ->Members = new struct MemberList; //    static_cast<Table*>(VariableAlloc(Parser, sizeof(struct Table) + STRUCT_TABLE_SIZE * sizeof(struct TableEntry), TRUE));
     // obsoleteTyp->Members->HashTable = (struct TableEntry **)((char *)Typ->Members + sizeof(struct Table));
 	// obsoleteTyp->Members->TableInitTable((struct TableEntry **)((char *)Typ->Members + sizeof(struct Table)), STRUCT_TABLE_SIZE, TRUE);
 	// obsolete Typ->Members->TableInitTable(&Typ->Members->publicMap);
@@ -317,6 +427,7 @@ void ParseState::TypeParseEnum(struct ValueType **Typ)
     {
         static char TempNameBuf[7] = "^e0000";
 		EnumIdentifier = pc->PlatformMakeTempName(TempNameBuf);
+        pc->TypeCacheable = FALSE;
     }
 
     TypeGetMatching( &pc->UberType, TypeEnum, 0, EnumIdentifier, Token != TokenLeftBrace);
@@ -333,8 +444,9 @@ void ParseState::TypeParseEnum(struct ValueType **Typ)
     if (pc->TopStackFrame() != NULL)
         Parser->ProgramFail( "enum definitions can only be globals");
         
+    pc->TypeCacheable = FALSE;
     Parser->LexGetToken( NULL, TRUE);    
-    (*Typ)->Members = &pc->GlobalTable;
+    (*Typ)->Members = &pc->NoMembers;
     // obsolete memset((void *)&InitValue, '\0', sizeof(struct Value));
     InitValue.TypeOfValue = &pc->IntType;
     InitValue.setValAbsolute(pc,  (UnionAnyValuePointer )&EnumValue);
@@ -360,8 +472,77 @@ void ParseState::TypeParseEnum(struct ValueType **Typ)
     } while (Token == TokenComma);
 }
 
-/* parse a type - just the basic type */
+/* forget all cached type parses - called whenever token memory is freed */
+void Picoc::TypeCacheClear()
+{
+	Picoc *pc = this;
+    pc->TypeFrontCache.clear();
+    pc->TypeIdentCache.clear();
+}
+
+/* move the parser to the end of a cached type parse */
+static void TypeCacheSkip(struct ParseState *Parser, struct TypeCacheEntry *Entry)
+{
+    Parser->Pos = Entry->EndPos;
+    Parser->Line += Entry->LineDelta;
+    Parser->CharacterPos = Entry->CharacterPos;
+}
+
+/* remember where a type parse starting at StartPos finished */
+static void TypeCacheStore(struct ParseState *Parser, struct TypeCacheEntry *Entry, short int StartLine)
+{
+    Entry->EndPos = Parser->Pos;
+    Entry->LineDelta = Parser->Line - StartLine;
+    Entry->CharacterPos = Parser->CharacterPos;
+    Entry->Epoch = Parser->pc->TypeCacheEpoch;
+}
+
+/* parse a type - just the basic type. the result is cached by token position */
 int ParseState::TypeParseFront(struct ValueType **Typ, int *IsStatic)
+{
+	struct ParseState *Parser = this;
+    const unsigned char *StartPos = Parser->Pos;
+    short int StartLine = Parser->Line;
+    int OldCacheable = pc->TypeCacheable;
+    int UseCache = Parser->FileName != pc->StrEmpty;    /* interactive token lines come and go */
+    int StaticQualifier = FALSE;
+    int Result;
+
+    if (UseCache)
+    {
+        auto Cached = pc->TypeFrontCache.find(StartPos);
+        if (Cached != pc->TypeFrontCache.end() && Cached->second.Epoch == pc->TypeCacheEpoch)
+        {
+            *Typ = Cached->second.Typ;
+            if (IsStatic != NULL)
+                *IsStatic = Cached->second.IsStatic;
+                
+            TypeCacheSkip(Parser, &Cached->second);
+            return TRUE;
+        }
+    }
+
+    pc->TypeCacheable = TRUE;
+    Result = TypeParseFrontNoCache( Typ, &StaticQualifier);
+    if (IsStatic != NULL)
+        *IsStatic = StaticQualifier;
+        
+    if (UseCache && Result && pc->TypeCacheable)
+    {
+        struct TypeCacheEntry &Entry = pc->TypeFrontCache[StartPos];
+        Entry.FromType = NULL;
+        Entry.Typ = *Typ;
+        Entry.Identifier = NULL;
+        Entry.IsStatic = StaticQualifier;
+        TypeCacheStore(Parser, &Entry, StartLine);
+    }
+    
+    pc->TypeCacheable = OldCacheable && pc->TypeCacheable;
+    return Result;
+}
+
+/* parse a type - just the basic type */
+int ParseState::TypeParseFrontNoCache(struct ValueType **Typ, int *IsStatic)
 {
 	struct ParseState *Parser = this;
     struct ParseState Before;
@@ -466,6 +647,13 @@ struct ValueType *ParseState::TypeParseBack(struct ValueType *FromType)
             /* get a numeric array size */
             enum RunMode OldMode = Parser->Mode;
             int ArraySize;
+            struct ParseState Peek;
+            
+            /* only a literal size gives the same type every time */
+            ParserCopy(&Peek, Parser);
+            if (Peek.LexGetToken( NULL, TRUE) != TokenIntegerConstant || Peek.LexGetToken( NULL, FALSE) != TokenRightSquareBracket)
+                pc->TypeCacheable = FALSE;
+                
             Parser->Mode = RunModeRun;
             ArraySize = Parser->ExpressionParseInt();
             Parser->Mode = OldMode;
@@ -484,8 +672,45 @@ struct ValueType *ParseState::TypeParseBack(struct ValueType *FromType)
     }
 }
 
-/* parse a type - the part which is repeated with each identifier in a declaration list */
+/* parse a type - the part which is repeated with each identifier in a declaration list.
+ * the result is cached by token position */
 void ParseState::TypeParseIdentPart(struct ValueType *BasicTyp, struct ValueType **Typ, const char **Identifier)
+{
+	struct ParseState *Parser = this;
+    const unsigned char *StartPos = Parser->Pos;
+    short int StartLine = Parser->Line;
+    int OldCacheable = pc->TypeCacheable;
+    int UseCache = Parser->FileName != pc->StrEmpty;
+
+    if (UseCache)
+    {
+        auto Cached = pc->TypeIdentCache.find(StartPos);
+        if (Cached != pc->TypeIdentCache.end() && Cached->second.Epoch == pc->TypeCacheEpoch && Cached->second.FromType == BasicTyp)
+        {
+            *Typ = Cached->second.Typ;
+            *Identifier = Cached->second.Identifier;
+            TypeCacheSkip(Parser, &Cached->second);
+            return;
+        }
+    }
+
+    pc->TypeCacheable = TRUE;
+    TypeParseIdentPartNoCache( BasicTyp, Typ, Identifier);
+    if (UseCache && pc->TypeCacheable)
+    {
+        struct TypeCacheEntry &Entry = pc->TypeIdentCache[StartPos];
+        Entry.FromType = BasicTyp;
+        Entry.Typ = *Typ;
+        Entry.Identifier = *Identifier;
+        Entry.IsStatic = FALSE;
+        TypeCacheStore(Parser, &Entry, StartLine);
+    }
+    
+    pc->TypeCacheable = OldCacheable && pc->TypeCacheable;
+}
+
+/* parse a type - the part which is repeated with each identifier in a declaration list */
+void ParseState::TypeParseIdentPartNoCache(struct ValueType *BasicTyp, struct ValueType **Typ, const char **Identifier)
 {
 	struct ParseState *Parser = this;
     struct ParseState Before;
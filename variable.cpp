@@ -32,23 +32,37 @@ void Picoc::VariableFree(struct Value *ValueIn)
         /* free function bodies */
 		if (ValueIn->TypeOfValue == &pc->FunctionType && ValueIn->getValAbsolute()->FuncDef().Intrinsic == nullptr &&
 			ValueIn->getValAbsolute()->FuncDef().Body.getPos() != nullptr)
+		{
 			HeapFreeMem((void *)ValueIn->getValAbsolute()->FuncDef().Body.getPos());
+			LexTokenCacheClear();
+		}
 
         /* free macro bodies */
 		if (ValueIn->TypeOfValue == &pc->MacroType)
+		{
             HeapFreeMem( (void *)ValueIn->getValAbsolute()->MacroDef().Body.getPos());
+			LexTokenCacheClear();
+		}
 
         /* free the AnyValue */
 		if (ValueIn->AnyValOnHeap && ValueIn->isAnyValueAllocated) {
 #ifdef DEBUG_ALLOCATIONS
 			fprintf(stderr, "Release memory here ValueFromHeap %08x\n", ValueIn->getValVirtual());
 #endif
-			HeapFreeMem(ValueIn->getValVirtual());
+			if (ValueIn->isAbsolute)
+				HeapFreeMem(ValueIn->getValAbsolute());
+			else
+				HeapFreeVirtualMem(ValueIn->getValVirtual());
 		}
     }
 
     /* free the value */
-	if (ValueIn->ValOnHeap){
+	if (ValueIn->ValInPool)
+	{
+		pc->HeapQuotaRelease(ValueIn->ValInPool * POOL_GRANULE);
+		pc->ValuePool.PoolFree(ValueIn, ValueIn->ValInPool);
+	}
+	else if (ValueIn->ValOnHeap){
 #ifdef DEBUG_ALLOCATIONS
 		fprintf(stderr, "Release memory here Value %08x\n", static_cast<void*>(ValueIn));
 #endif
@@ -88,8 +102,12 @@ void Picoc::VariableTableCleanup(struct Table *HashTable)
 void Picoc::VariableCleanup()
 {
  	Picoc *pc = this;
+    VariableCacheClear();
     VariableTableCleanup( &pc->GlobalTable);
     VariableTableCleanup( &pc->StringLiteralTable);
+    
+    /* the tables held the last of the pooled values */
+    pc->ValuePool.PoolRelease();
 }
 
 /* allocate some memory, either on the heap or the stack and check if we've run out */
@@ -121,6 +139,8 @@ void *ParseState::VariableAlloc( int Size, MemoryLocation OnHeap)
 	default:
 		assert(!"wrong switch by type in VariableAlloc");
 	}
+    if (NewValue == nullptr && OnHeap == LocationOnStack)
+		Parser->ProgramFailStack();
     if (NewValue == nullptr)
 		Parser->ProgramFail("out of memory");
     
@@ -131,6 +151,20 @@ void *ParseState::VariableAlloc( int Size, MemoryLocation OnHeap)
     return NewValue;
 }
 
+/* allocate a cleared block from the value pool and check if we've run out */
+void *ParseState::VariableAllocPooled(int Class)
+{
+	struct ParseState *Parser = this;
+	void *NewValue;
+	
+	pc->HeapQuotaCharge(Class * POOL_GRANULE);
+	NewValue = pc->ValuePool.PoolAlloc(Class);
+	if (NewValue == nullptr)
+		Parser->ProgramFail("out of memory");
+
+	return NewValue;
+}
+
 /* allocate some memory, either on the heap or the stack and check if we've run out */
 UnionAnyValuePointerVirtual ParseState::VariableAllocVirtual(int Size, MemoryLocation OnHeap)
 {
@@ -151,6 +185,8 @@ UnionAnyValuePointerVirtual ParseState::VariableAllocVirtual(int Size, MemoryLoc
 	default:
 		assert(!"wrong switch by type in VariableAlloc");
 	}
+	if (NewValue == nullptr && OnHeap == LocationOnStackVirtual)
+		Parser->ProgramFailStack();
 	if (NewValue == nullptr)
 		Parser->ProgramFail("out of memory");
 
@@ -182,6 +218,17 @@ struct Value *ParseState::VariableAllocValueAndData(int DataSize, int IsLValue,
 			NewValue->AnyValOnHeap = false;
 			NewValue->isAbsolute = false;
 	}
+	else if (OnHeap == LocationOnHeap && SizeClassPool::PoolClass(MEM_ALIGN(sizeof(struct Value)) + DataSize) != 0) {
+		/* small values share a pool block with their data */
+		int Class = SizeClassPool::PoolClass(MEM_ALIGN(sizeof(struct Value)) + DataSize);
+		NewValue = static_cast<struct Value*>(VariableAllocPooled(Class));
+		NewValue->valueCreationSource = 5;
+		NewValue->isAnyValueAllocated = false;
+		NewValue->setValAbsolute(pc, (UnionAnyValuePointer)((char *)NewValue + MEM_ALIGN(sizeof(struct Value))));
+		NewValue->AnyValOnHeap = false;
+		NewValue->isAbsolute = true;
+		NewValue->ValInPool = Class;
+	}
 	else if (OnHeap == LocationOnHeap) {
 		NewValue = static_cast<struct Value*>(VariableAlloc(MEM_ALIGN(sizeof(struct Value)), OnHeap));
 		NewValue->valueCreationSource = 5;
@@ -193,7 +240,9 @@ struct Value *ParseState::VariableAllocValueAndData(int DataSize, int IsLValue,
 		NewValue->isAbsolute = true;
 	}
 	else if (OnHeap == LocationOnHeapVirtual) {
-		NewValue = static_cast<struct Value*>(VariableAlloc(MEM_ALIGN(sizeof(struct Value)), LocationOnHeap /*OnHeap*/ ));
+		int Class = SizeClassPool::PoolClass(MEM_ALIGN(sizeof(struct Value)));
+		NewValue = static_cast<struct Value*>(Class != 0 ? VariableAllocPooled(Class) : VariableAlloc(MEM_ALIGN(sizeof(struct Value)), LocationOnHeap /*OnHeap*/ ));
+		NewValue->ValInPool = Class;
 		UnionAnyValuePointerVirtual newData = static_cast<UnionAnyValuePointerVirtual>(VariableAllocVirtual(DataSize, OnHeap));
 		NewValue->valueCreationSource = 6;
 		NewValue->isAnyValueAllocated = false;
@@ -213,11 +262,38 @@ struct Value *ParseState::VariableAllocValueAndData(int DataSize, int IsLValue,
     
     return NewValue;
 }
+/* allocate a value on the stack whose data isn't cleared. only the header is
+ * zeroed, so the caller must write all of the data before it's read */
+struct Value *ParseState::VariableAllocValueAndDataUncleared(int DataSize, int IsLValue, struct Value *LValueFrom)
+{
+	struct ParseState *Parser = this;
+	struct Value *NewValue = static_cast<struct Value*>(pc->HeapAllocStackUncleared(MEM_ALIGN(sizeof(struct Value)) + DataSize));
+	if (NewValue == nullptr)
+		Parser->ProgramFailStack();
+
+	memset((void *)NewValue, '\0', MEM_ALIGN(sizeof(struct Value)));
+	NewValue->valueCreationSource = 3;
+	NewValue->isAnyValueAllocated = false;
+	NewValue->setValAbsolute(pc, (UnionAnyValuePointer)((char *)NewValue + MEM_ALIGN(sizeof(struct Value))));
+	NewValue->AnyValOnHeap = false;
+	NewValue->isAbsolute = true;
+	NewValue->ValOnHeap = LocationOnStack;
+	NewValue->ValOnStack = TRUE;
+	NewValue->IsLValue = IsLValue;
+	NewValue->LValueFrom = LValueFrom;
+	NewValue->ScopeID = Parser->getScopeID();
+
+	return NewValue;
+}
+
 /* allocate a value either on the heap or the stack using space dependent on what type we want */
 struct ValueAbs *ParseState::VariableAllocValueAndDataAbsolute(int DataSize, int IsLValue, struct Value *LValueFrom, MemoryLocation OnHeap)
 {
 	struct ParseState *Parser = this;
-	struct ValueAbs *NewValue = static_cast<struct ValueAbs*>(VariableAlloc(MEM_ALIGN(sizeof(struct ValueAbs)) + DataSize, OnHeap));
+	int Class = (OnHeap == LocationOnHeap) ? SizeClassPool::PoolClass(MEM_ALIGN(sizeof(struct ValueAbs)) + DataSize) : 0;
+	struct ValueAbs *NewValue = static_cast<struct ValueAbs*>(Class != 0 ? VariableAllocPooled(Class) : 
+		VariableAlloc(MEM_ALIGN(sizeof(struct ValueAbs)) + DataSize, OnHeap));
+	NewValue->ValInPool = Class;
 	NewValue->valueCreationSource = 7;
 	NewValue->setValAbsolute(pc, (UnionAnyValuePointer)((char *)NewValue + MEM_ALIGN(sizeof(struct ValueAbs)))); 
 	//	NewValue->setVal((UnionAnyValuePointer)(static_cast<char *>(VariableAlloc(Parser,  DataSize, LocationVirtual)))); 
@@ -248,6 +324,16 @@ struct Value *LValueFrom, MemoryLocation OnHeap)
     return NewValue;
 }
 
+/* allocate a value on the stack given its type, without clearing its data */
+struct Value *ParseState::VariableAllocValueFromTypeUncleared(struct ValueType *Typ, int IsLValue, struct Value *LValueFrom)
+{
+	int Size = TypeSize(Typ, Typ->ArraySize, FALSE);
+    struct Value *NewValue = VariableAllocValueAndDataUncleared( Size, IsLValue, LValueFrom);
+    assert(Size >= 0 || Typ == &pc->VoidType);
+    NewValue->TypeOfValue = Typ;
+    return NewValue;
+}
+
 /* allocate a value either on the heap or the stack and copy its value. handles overlapping data */
 struct Value *ParseState::VariableAllocValueAndCopy(struct Value *FromValue, MemoryLocation OnHeap)
 {
@@ -260,7 +346,11 @@ struct Value *ParseState::VariableAllocValueAndCopy(struct Value *FromValue, Mem
     assert(CopySize <= MAX_TMP_COPY_BUF);
 	if (OnHeap == LocationOnHeap || OnHeap == LocationOnStack){
 		memcpy((void *)&TmpBuf[0], static_cast<void *>(FromValue->isAbsolute ? FromValue->getValAbsolute() : FromValue->getValVirtual()), CopySize); 
-		NewValue = VariableAllocValueAndData(CopySize, FromValue->IsLValue, FromValue->LValueFrom, OnHeap);
+		/* the copy overwrites all of the data so there's no need to clear it first */
+		if (OnHeap == LocationOnStack)
+			NewValue = VariableAllocValueAndDataUncleared(CopySize, FromValue->IsLValue, FromValue->LValueFrom);
+		else
+			NewValue = VariableAllocValueAndData(CopySize, FromValue->IsLValue, FromValue->LValueFrom, OnHeap);
 		NewValue->TypeOfValue = DType;
 		memcpy((void *)NewValue->getValAbsolute(), (void *)&TmpBuf[0], CopySize); 
 	}
@@ -368,17 +458,38 @@ void ParseState::VariableRealloc(struct Value *FromValue, int NewSize)
 void ParseState::VariableReallocAbsolute(struct Value *FromValue, int NewSize)
 {
 	struct ParseState *Parser = this;
-	FromValue->setValAbsolute(pc, static_cast<UnionAnyValuePointer >(VariableAlloc(NewSize, LocationOnHeap)));
+	UnionAnyValuePointer NewData = static_cast<UnionAnyValuePointer >(VariableAlloc(NewSize, LocationOnHeap));
+	
+	if (FromValue->AnyValOnHeap && FromValue->isAnyValueAllocated && FromValue->isAbsolute)
+		pc->HeapFreeMem(FromValue->getValAbsolute());
+	
+	FromValue->setValAbsolute(pc, NewData);
 	FromValue->valueCreationSource = 12;
 	FromValue->AnyValOnHeap = TRUE;
+	VariableReallocOwner(FromValue, NewData, true);
 }
 /* reallocate a variable so its data has a new size */
 void ParseState::VariableReallocVirtual(struct Value *FromValue, int NewSize)
 {
 	struct ParseState *Parser = this;
-	FromValue->setValVirtual(pc, static_cast<UnionAnyValuePointerVirtual >(VariableAllocVirtual(NewSize, LocationOnHeapVirtual)));
+	UnionAnyValuePointerVirtual NewData = static_cast<UnionAnyValuePointerVirtual >(VariableAllocVirtual(NewSize, LocationOnHeapVirtual));
+	
+	FromValue->setValVirtual(pc, NewData);
 	FromValue->valueCreationSource = 13;
 	FromValue->AnyValOnHeap = TRUE;
+	VariableReallocOwner(FromValue, NewData, false);
+}
+
+/* a variable's data has been moved to a heap block of its own. a heap variable frees it with 
+ * itself; a local's is freed when the call returns */
+void ParseState::VariableReallocOwner(struct Value *FromValue, void *NewData, bool isAbsolute)
+{
+	struct ParseState *Parser = this;
+	
+	if (FromValue->ValOnHeap == LocationOnHeap || FromValue->ValOnHeap == LocationOnHeapVirtual)
+		FromValue->isAnyValueAllocated = true;
+	else if (pc->TopStackFrame() != nullptr)
+		pc->TopStackFrame()->ReallocData.emplace_back(NewData, isAbsolute);
 }
 
 
@@ -391,99 +502,44 @@ void ParseState::VariableRealloc(struct ValueAbs *FromValue, int NewSize)
 	FromValue->AnyValOnHeap = TRUE;
 }
 
+/* enter a block. returns the block's mark on the current table's scope stack, or -1 if scoping is off */
 int ParseState::VariableScopeBegin(int* OldScopeID)
 {
 	struct ParseState * Parser = this;
     Picoc * pc = Parser->pc;
-    #ifdef VAR_SCOPE_DEBUG
-    int FirstPrint = 0;
-    #endif
-    
-    struct Table * HashTable = (pc->TopStackFrame() == NULL) ? &(pc->GlobalTable) : (pc->TopStackFrame())->LocalTable.get();
 
     if (Parser->ScopeID == -1) return -1;
 
-    /* XXX dumb hash, let's hope for no collisions... */
     *OldScopeID = Parser->ScopeID;
-    Parser->ScopeID = (int)(intptr_t)(Parser->SourceText) * ((int)(intptr_t)(Parser->Pos) / sizeof(char*));
-    /* or maybe a more human-readable hash for debugging? */
-    /* Parser->ScopeID = Parser->Line * 0x10000 + Parser->CharacterPos; */
-	HashTable->TableForEach(nullptr, [&Parser](Picoc *pc, TableEntry *Entry){
-	//	for (Count = 0; Count < HashTable->Size; Count++)
-	//	{
-	//		for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
-	//		{
-	//			NextEntry = Entry->Next;
-				if (Entry->p.v.ValInValueEntry->ScopeID == Parser->ScopeID && Entry->p.v.ValInValueEntry->OutOfScope)
-				{
-					Entry->p.v.ValInValueEntry->OutOfScope = FALSE;
-					Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key & ~1);
+    Parser->ScopeID = pc->GetCurrentTable()->TableScopeMark();
 #ifdef VAR_SCOPE_DEBUG
-					if (!FirstPrint) { PRINT_SOURCE_POS; }
-					FirstPrint = 1;
-					printf(">>> back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.ValInValueEntry->ScopeID, Entry->p.v.ValInValueEntry->getVal<int>(pc));
+    PRINT_SOURCE_POS;
+    printf(">>> scope begin: %d\n", Parser->ScopeID);
 #endif
-				}
-	//		}
-	//	}
-	});
 
     return Parser->ScopeID;
 }
 
+/* leave a block, hiding the variables it brought into scope */
 void ParseState::VariableScopeEnd(int ScopeID, int PrevScopeID)
 {
 	struct ParseState * Parser = this;
     Picoc * pc = Parser->pc;
-    #ifdef VAR_SCOPE_DEBUG
-    int FirstPrint = 0;
-    #endif
-
-    struct Table * HashTable = (pc->TopStackFrame() == NULL) ? &(pc->GlobalTable) : (pc->TopStackFrame())->LocalTable.get();
 
     if (ScopeID == -1) return;
 
-	HashTable->TableForEach(nullptr, [&ScopeID](Picoc *pc, TableEntry *Entry){
-		//   for (Count = 0; Count < HashTable->Size; Count++)
-		//   {
-		//      for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
-		//      {
-		//          NextEntry = Entry->Next;
-		if (Entry->p.v.ValInValueEntry->ScopeID == ScopeID && !Entry->p.v.ValInValueEntry->OutOfScope)
-		{
 #ifdef VAR_SCOPE_DEBUG
-			if (!FirstPrint) { PRINT_SOURCE_POS; }
-			FirstPrint = 1;
-			printf(">>> out of scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.ValInValueEntry->ScopeID, Entry->p.v.ValInValueEntry->getVal<int>(pc));
+    PRINT_SOURCE_POS;
+    printf(">>> scope end: %d\n", ScopeID);
 #endif
-			Entry->p.v.ValInValueEntry->OutOfScope = TRUE;
-			Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key | 1); /* alter the key so it won't be found by normal searches */
-		}
-		//    }
-		// }
-
-	});
-
+    pc->GetCurrentTable()->TableScopeEnd(ScopeID);
     Parser->ScopeID = PrevScopeID;
 }
 
 bool Picoc::VariableDefinedAndOutOfScope( const char* Ident)
 {
 	Picoc * pc = this;
-
-    struct Table * HashTable = (pc->TopStackFrame() == NULL) ? &(pc->GlobalTable) : (pc->TopStackFrame())->LocalTable.get();
-	return HashTable->TableFindIf(pc, [Ident](Picoc *pc, TableEntry *Entry){
-		//for (Count = 0; Count < HashTable->Size; Count++)
-		//{
-		//	for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = Entry->Next)
-		//	{
-		if (Entry->p.v.ValInValueEntry->OutOfScope && (char*)((intptr_t)Entry->p.v.Key & ~1) == Ident)
-			return true;
-		else
-			return false;
-		//	}
-		//}
-	});
+	return pc->GetCurrentTable()->TableIsHidden(Ident) || pc->VariableSlotGet(Ident, true) != nullptr;
 }
 
 /* define a variable. Ident must be registered */
@@ -492,29 +548,166 @@ struct Value *ParseState::VariableDefine(const char *Ident, struct Value *InitVa
 	struct ParseState *Parser = this;
 	Picoc * pc = Parser->pc;
     struct Value * AssignValue;
-	struct Table * currentTable = pc->GetCurrentTable(); // (pc->TopStackFrame() == NULL) ? &(pc->GlobalTable) : (pc->TopStackFrame())->LocalTable.get();
+	struct Table * currentTable = pc->GetCurrentTable();
+	MemoryLocation OnHeap = pc->TopStackFrame() == NULL ? LocationOnHeapVirtual : LocationOnStackVirtual; // (pc->TopStackFrame() == NULL) ? &(pc->GlobalTable) : (pc->TopStackFrame())->LocalTable.get();
     
     int scopeID = Parser ? Parser->getScopeID() : -1;
 #ifdef VAR_SCOPE_DEBUG
     if (Parser) fprintf(stderr, "def %s %x (%s:%d:%d)\n", Ident, ScopeID, Parser->FileName, Parser->Line, Parser->CharacterPos);
 #endif
     
+    /* a typedef's value is one of the interpreter's own types, so it's kept away from the memory the program can reach */
+    if ((InitValue != NULL ? InitValue->TypeOfValue : Typ)->Base == Type_Type)
+        OnHeap = pc->TopStackFrame() == NULL ? LocationOnHeap : LocationOnStack;
+    
     if (InitValue != NULL)
-        AssignValue = VariableAllocValueAndCopy(  InitValue, pc->TopStackFrame() == NULL?LocationOnHeap:LocationOnStackVirtual);
+        AssignValue = VariableAllocValueAndCopy(  InitValue, OnHeap);
     else
-		AssignValue = VariableAllocValueFromType( Typ, MakeWritable, NULL, pc->TopStackFrame() == NULL ? LocationOnHeap : LocationOnStackVirtual);
+		AssignValue = VariableAllocValueFromType( Typ, MakeWritable, NULL, OnHeap);
     
     AssignValue->IsLValue = MakeWritable;
     AssignValue->ScopeID = scopeID;
     AssignValue->OutOfScope = FALSE;
 
+    /* a new typedef may change what cached type parses mean */
+    if (AssignValue->TypeOfValue->Base == Type_Type)
+        pc->TypeCacheEpoch++;
+
     if (!pc->TableSet( currentTable, Ident, AssignValue, 
 		Parser ? ((char *)Parser->FileName) : NULL, Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
 		Parser->ProgramFail( "'%s' is already defined", Ident);
     
+    if (scopeID != -1)
+        currentTable->TableScopeAdd(Ident, AssignValue);
+    
     return AssignValue;
 }
 
+/* get the frame layout for a user-defined function, starting one with just the parameters if it's new */
+std::shared_ptr<struct FrameLayout> ParseState::VariableFrameLayout(struct ValueAbs *FuncValue)
+{
+	struct ParseState *Parser = this;
+	std::shared_ptr<struct FrameLayout> &Layout = pc->FrameLayouts[FuncValue->ValFuncDef(pc).Body.Pos];
+    int Count;
+
+    if (Layout == nullptr)
+    {
+        Layout = std::make_shared<struct FrameLayout>();
+        Layout->Size = 0;
+        for (Count = 0; Count < FuncValue->ValFuncDef(pc).NumParams; Count++)
+        {
+            struct ValueType *Typ = FuncValue->ValFuncDef(pc).ParamType[Count];
+            Layout->SlotsOfName[FuncValue->ValFuncDef(pc).ParamName[Count]].push_back(Count);
+            Layout->Names.insert(FuncValue->ValFuncDef(pc).ParamName[Count]);
+            Layout->Slots.push_back(FrameSlot{ FuncValue->ValFuncDef(pc).ParamName[Count], Typ, Layout->Size });
+            Layout->Size += MEM_ALIGN(TypeSize(Typ, Typ->ArraySize, FALSE));
+        }
+    }
+
+    return Layout;
+}
+
+/* set up the value for a slot of a call's frame block. it's the same as a LocationOnStackVirtual value */
+struct Value *ParseState::VariableSlotValue(struct Value *SlotValues, char *SlotData, struct FrameLayout *Layout, int SlotNo)
+{
+	struct ParseState *Parser = this;
+    struct Value *NewValue = (struct Value *)((char *)SlotValues + SlotNo * MEM_ALIGN(sizeof(struct Value)));
+
+    NewValue->valueCreationSource = 4;
+    NewValue->TypeOfValue = Layout->Slots[SlotNo].Typ;
+    NewValue->isAnyValueAllocated = false;
+    NewValue->setValVirtual(pc, (UnionAnyValuePointerVirtual)(SlotData + Layout->Slots[SlotNo].Offset));
+    NewValue->AnyValOnHeap = false;
+    NewValue->isAbsolute = false;
+    NewValue->ValOnHeap = FALSE;
+    NewValue->ValOnStack = TRUE;
+    NewValue->IsLValue = FALSE;
+    NewValue->LValueFrom = NULL;
+    NewValue->ScopeID = Parser->getScopeID();
+    NewValue->OutOfScope = FALSE;
+
+    return NewValue;
+}
+
+/* define a local variable in its slot of the current frame. the first time a declaration is run it's given a slot
+ * for later calls and allocated separately. slots aren't put in the local table - they're found by name through 
+ * the layout. Ident must be registered */
+struct Value *ParseState::VariableDefineInFrame(const char *Ident, struct ValueType *Typ)
+{
+	struct ParseState *Parser = this;
+    struct StackFrame *Frame = pc->TopStackFrame();
+    struct FrameLayout *Layout = Frame->Layout.get();
+    struct Value *NewValue;
+    int SlotNo;
+    auto Found = Layout->SlotOfDecl.find(Parser->Pos);
+
+    if (Found == Layout->SlotOfDecl.end())
+    {
+        Layout->SlotOfDecl[Parser->Pos] = (int)Layout->Slots.size();
+        Layout->SlotsOfName[Ident].push_back((int)Layout->Slots.size());
+        Layout->Slots.push_back(FrameSlot{ Ident, Typ, Layout->Size });
+        Layout->Size += MEM_ALIGN(TypeSize(Typ, Typ->ArraySize, FALSE));
+        return VariableDefine( Ident, NULL, Typ, TRUE);
+    }
+
+    /* use the slot unless this call's block is too small for it or the declaration's type has changed */
+    SlotNo = Found->second;
+    if (SlotNo >= Frame->NumSlots || Layout->Slots[SlotNo].Typ != Typ || Layout->Slots[SlotNo].Ident != Ident)
+        return VariableDefine( Ident, NULL, Typ, TRUE);
+
+    /* the declaration's been run before in this call. if it's still in scope it's the same variable, 
+     * otherwise we're coming back round to a block we've been in before and reuse it */
+    NewValue = (struct Value *)((char *)Frame->SlotValues + SlotNo * MEM_ALIGN(sizeof(struct Value)));
+    if (NewValue->TypeOfValue != NULL)
+    {
+        if (Parser->Line == 0 || (NewValue->OutOfScope && Parser->ScopeID == -1))
+            return VariableDefine( Ident, NULL, Typ, TRUE);
+        
+        if (NewValue->OutOfScope)
+        {
+            NewValue->OutOfScope = FALSE;
+            Frame->LocalTable->TableScopeAddSlot(NewValue);
+        }
+        
+        return NewValue;
+    }
+
+    NewValue = VariableSlotValue(Frame->SlotValues, Frame->SlotData, Layout, SlotNo);
+    NewValue->IsLValue = TRUE;
+    if (Parser->ScopeID != -1)
+        Frame->LocalTable->TableScopeAddSlot(NewValue);
+
+    return NewValue;
+}
+
+/* find a parameter or local of the current call by name in the call's frame slots. with OutOfScope it finds 
+ * one that's been hidden by the end of its block instead. returns NULL if there isn't one */
+struct Value *Picoc::VariableSlotGet(const char *Ident, bool OutOfScope)
+{
+	Picoc * pc = this;
+    struct StackFrame *Frame = pc->TopStackFrame();
+    struct Value *SlotValue;
+
+    if (Frame == nullptr || Frame->Layout == nullptr)
+        return nullptr;
+
+    auto Found = Frame->Layout->SlotsOfName.find(Ident);
+    if (Found == Frame->Layout->SlotsOfName.end())
+        return nullptr;
+
+    for (int SlotNo : Found->second)
+    {
+        if (SlotNo >= Frame->NumSlots)
+            break;
+        
+        SlotValue = (struct Value *)((char *)Frame->SlotValues + SlotNo * MEM_ALIGN(sizeof(struct Value)));
+        if (SlotValue->TypeOfValue != NULL && (bool)SlotValue->OutOfScope == OutOfScope)
+            return SlotValue;
+    }
+
+    return nullptr;
+}
+
 /* define a variable. Ident must be registered. If it's a redefinition from the same declaration don't throw an error */
 struct Value *ParseState::VariableDefineButIgnoreIdentical( const char *Ident, struct ValueType *Typ, int IsStatic, int *FirstVisit)
 {
@@ -564,18 +757,49 @@ struct Value *ParseState::VariableDefineButIgnoreIdentical( const char *Ident, s
             *FirstVisit = TRUE;
         }
 
-        /* static variable exists in the global scope - now make a mirroring variable in our own scope with the short name */
-		VariableDefinePlatformVar( Ident, ExistingValue->TypeOfValue, ExistingValue->getValVirtual(), TRUE,0);
+        /* static variable exists in the global scope - now make a mirroring variable in our own scope with the short name.
+         * inside a function the mirror goes on the stack so it goes away with the call */
+        if (pc->TopStackFrame() == NULL)
+            VariableDefinePlatformVar( Ident, ExistingValue->TypeOfValue, ExistingValue->getValVirtual(), TRUE,0);
+        else
+        {
+            struct Table *currentTable = pc->GetCurrentTable();
+            struct Value *MirrorValue;
+            
+            if (currentTable->TableGet( Ident, &MirrorValue, NULL, NULL, NULL))
+            {
+                if (MirrorValue->getValVirtual() != ExistingValue->getValVirtual())
+                    Parser->ProgramFail( "'%s' is already defined", Ident);
+            }
+            else
+            {
+                MirrorValue = VariableAllocValueFromExistingData( ExistingValue->TypeOfValue, 
+                    (UnionAnyValuePointer)ExistingValue->getValVirtual(), TRUE, NULL, false);
+                if (!pc->TableSet( currentTable, Ident, MirrorValue, (char *)Parser->FileName, Parser->Line, Parser->CharacterPos))
+                    Parser->ProgramFail( "'%s' is already defined", Ident);
+            }
+        }
         return ExistingValue;
     }
     else
     {
-		if (Parser->Line != 0 && ((pc->TopStackFrame() == nullptr) ? &pc->GlobalTable : 
-			pc->TopStackFrame()->LocalTable.get())->TableGet(Ident, &ExistingValue, &DeclFileName, &DeclLine, &DeclColumn)
+		struct Table *currentTable = pc->GetCurrentTable();
+		if (Parser->Line != 0 && currentTable->TableGet(Ident, &ExistingValue, &DeclFileName, &DeclLine, &DeclColumn)
                 && DeclFileName == Parser->FileName && DeclLine == Parser->Line && DeclColumn == Parser->CharacterPos)
             return ExistingValue;
-        else
-			return VariableDefine( Ident, NULL, Typ, TRUE);
+        
+        /* coming back round to a block we've been in before - reuse the variable from last time */
+		if (Parser->Line != 0 && Parser->ScopeID != -1 && 
+			(ExistingValue = currentTable->TableReveal(Ident, Parser->FileName, Parser->Line, Parser->CharacterPos)) != nullptr)
+        {
+            currentTable->TableScopeAdd(Ident, ExistingValue);
+            return ExistingValue;
+        }
+        
+        if (pc->TopStackFrame() != nullptr && pc->TopStackFrame()->Layout != nullptr)
+            return VariableDefineInFrame( Ident, Typ);
+        
+		return VariableDefine( Ident, NULL, Typ, TRUE);
     }
 }
 
@@ -585,7 +809,8 @@ int Picoc::VariableDefined( const char *Ident)
 	Picoc * pc = this;
     struct Value *FoundValue;
     
-	if (pc->TopStackFrame() == nullptr || !pc->TopStackFrame()->LocalTable->TableGet(Ident, &FoundValue, NULL, NULL, NULL))
+	if (pc->TopStackFrame() == nullptr || (pc->VariableSlotGet(Ident, false) == nullptr && 
+            !pc->TopStackFrame()->LocalTable->TableGet(Ident, &FoundValue, NULL, NULL, NULL)))
     {
 		if (!pc->GlobalTable.TableGet(Ident, &FoundValue, NULL, NULL, NULL))
             return FALSE;
@@ -594,12 +819,89 @@ int Picoc::VariableDefined( const char *Ident)
     return TRUE;
 }
 
+/* forget all cached identifier lookups */
+void Picoc::VariableCacheClear()
+{
+	Picoc * pc = this;
+    pc->VariableCache.clear();
+}
+
+/* look up a variable from a given token position, remembering the result for next
+ * time. returns NULL if it isn't defined. Ident must be registered */
+struct Value *ParseState::VariableLookup(const unsigned char *Site, const char *Ident)
+{
+	struct ParseState *Parser = this;
+	Picoc * pc = Parser->pc;
+    struct StackFrame *Frame = pc->TopStackFrame();
+    int UseCache = Parser->FileName != pc->StrEmpty;    /* interactive token lines come and go */
+    struct Value *FoundValue;
+
+    if (UseCache)
+    {
+        auto Cached = pc->VariableCache.find(Site);
+        if (Cached != pc->VariableCache.end())
+        {
+            struct VariableCacheEntry *Entry = &Cached->second;
+            
+            /* a local resolves to the same slot in every call, as long as it's been declared and is in scope */
+            if (Entry->Ident == Ident && Entry->Cell == nullptr && Entry->Layout != nullptr && Frame != nullptr && Entry->Layout == Frame->Layout.get() && 
+                    Entry->Slot < Frame->NumSlots)
+            {
+                FoundValue = (struct Value *)((char *)Frame->SlotValues + Entry->Slot * MEM_ALIGN(sizeof(struct Value)));
+                if (FoundValue->TypeOfValue != NULL && !FoundValue->OutOfScope)
+                    return FoundValue;
+            }
+            
+            /* a global goes straight to its binding cell, as long as nothing local could be hiding it */
+            if (Entry->Ident == Ident && Entry->Cell != nullptr && *Entry->Cell != nullptr && 
+                    (Frame == nullptr ? Entry->Layout == nullptr : 
+                        (Frame->Layout != nullptr && Entry->Layout == Frame->Layout.get() && Entry->LocalNames == Frame->Layout->Names.size())))
+                return *Entry->Cell;
+        }
+    }
+
+    struct Value **Cell = nullptr;
+	if (Frame == nullptr || ((FoundValue = pc->VariableSlotGet(Ident, false)) == nullptr && 
+            !Frame->LocalTable->TableGet(Ident, &FoundValue, NULL, NULL, NULL)))
+    {
+		if (!pc->GlobalTable.TableGet(Ident, &FoundValue, NULL, NULL, NULL))
+            return nullptr;
+        
+        if (UseCache && (Frame == nullptr || (Frame->Layout != nullptr && Frame->Layout->Names.count(Ident) == 0)))
+            Cell = pc->GlobalTable.TableBind(Ident);
+    }
+
+    if (UseCache)
+    {
+        struct VariableCacheEntry &Entry = pc->VariableCache[Site];
+        Entry.Ident = Ident;
+        Entry.Layout = nullptr;
+        Entry.Slot = 0;
+        Entry.Cell = Cell;
+        Entry.LocalNames = 0;
+        if (Cell != nullptr && Frame != nullptr)
+        {
+            Entry.Layout = Frame->Layout.get();
+            Entry.LocalNames = Frame->Layout->Names.size();
+        }
+        else if (Frame != nullptr && Frame->NumSlots > 0 && (char *)FoundValue >= (char *)Frame->SlotValues && 
+                (char *)FoundValue < (char *)Frame->SlotValues + Frame->NumSlots * MEM_ALIGN(sizeof(struct Value)))
+        {
+            Entry.Layout = Frame->Layout.get();
+            Entry.Slot = (int)(((char *)FoundValue - (char *)Frame->SlotValues) / MEM_ALIGN(sizeof(struct Value)));
+        }
+    }
+    
+    return FoundValue;
+}
+
 /* get the value of a variable. must be defined. Ident must be registered */
 void ParseState::VariableGet(const char *Ident, struct Value **LVal)
 {
 	struct ParseState *Parser = this;
 	Picoc * pc = Parser->pc;
-	if (pc->TopStackFrame() == nullptr || !pc->TopStackFrame()->LocalTable->TableGet(Ident, LVal, NULL, NULL, NULL))
+	if (pc->TopStackFrame() == nullptr || ((*LVal = pc->VariableSlotGet(Ident, false)) == nullptr && 
+            !pc->TopStackFrame()->LocalTable->TableGet(Ident, LVal, NULL, NULL, NULL)))
     {
 		if (!pc->GlobalTable.TableGet(Ident, LVal, NULL, NULL, NULL))
         {
@@ -615,7 +917,8 @@ void ParseState::VariableGet(const char *Ident, struct ValueAbs **LVal)
 {
 	struct ParseState *Parser = this;
 	Picoc * pc = Parser->pc;
-	if (pc->TopStackFrame() == nullptr || !pc->TopStackFrame()->LocalTable->TableGet(Ident, LVal, NULL, NULL, NULL))
+	if (pc->TopStackFrame() == nullptr || ((*LVal = static_cast<struct ValueAbs *>(pc->VariableSlotGet(Ident, false))) == nullptr && 
+            !pc->TopStackFrame()->LocalTable->TableGet(Ident, LVal, NULL, NULL, NULL)))
 	{
 		if (!pc->GlobalTable.TableGet(Ident, LVal, NULL, NULL, NULL))
 		{
@@ -691,31 +994,30 @@ void ParseState::VariableDefinePlatformVarFromPointer(const char *Ident, struct
 		Parser->ProgramFail("'%s' is already defined", Ident);
 }
 
-
-/* free and/or pop the top value off the stack. Var must be the top value on the stack! */
-void ParseState::VariableStackPop(struct Value *Var)
+/* free everything on the stack since Mark except Var, which moves down to
+ * Mark. Var must have been allocated after Mark was taken */
+struct Value *ParseState::VariableStackKeep(struct Value *Var, const struct StackMark &Mark)
 {
-    int Success;
 	struct ParseState *Parser = this;
-#ifdef DEBUG_HEAP
-    if (Var->ValOnStack)
-        printf("popping %ld at 0x%lx\n", (unsigned long)(sizeof(struct Value) + TypeSizeValue(Var, FALSE)), (unsigned long)Var);
-#endif
-        
-    if (Var->ValOnHeap)
-    { 
-        if (Var->getValVirtual() != NULL)
-			Parser->pc->HeapFreeMem(Var->getValVirtual());
-            
-		Success = Parser->pc->HeapPopStack( Var, sizeof(struct Value));                       /* free from heap */
-    }
-    else if (Var->ValOnStack)
-		Success = Parser->pc->HeapPopStack(Var, sizeof(struct Value) + Var->TypeSizeValue(FALSE));  /* free from stack */
-    else
-		Success = Parser->pc->HeapPopStack( Var, sizeof(struct Value));                       /* value isn't our problem */
-        
-    if (!Success)
-        ProgramFail( "stack underrun");
+	struct Value *NewValue = static_cast<struct Value *>(Mark.Top);
+	bool DataInline = Var->ValOnStack && Var->isAbsolute && 
+		Var->getValAbsolute() == (UnionAnyValuePointer)((char *)Var + MEM_ALIGN(sizeof(struct Value)));
+	int Size = MEM_ALIGN(sizeof(struct Value)) + (DataInline ? Var->TypeStackSizeValue() : 0);
+	struct StackMark KeepMark;
+
+	assert((void *)Var >= Mark.Top);
+	if (NewValue != Var)
+	{
+		memmove((void *)NewValue, (void *)Var, Size);
+		if (DataInline)
+			NewValue->setValAbsolute(pc, (UnionAnyValuePointer)((char *)NewValue + MEM_ALIGN(sizeof(struct Value))));
+	}
+
+	/* Var's data may live on the virtual stack, so that one is left alone */
+	KeepMark.Top = (char *)NewValue + MEM_ALIGN(Size);
+	KeepMark.TopVirtual = Parser->pc->HeapStackTopVirtual;
+	Parser->pc->HeapResetStack(KeepMark);
+	return NewValue;
 }
 
 /* add a stack frame when doing a function call */
@@ -730,7 +1032,7 @@ void ParseState::VariableStackFrameAdd(const char *FuncName, int NumParams)
 	if (NumParams > 0){
 		NewFrameParameters = static_cast<struct Value**>(Parser->pc->HeapAllocStack(sizeof(struct Value *) * NumParams));
 	if (NewFrameParameters == nullptr)
-		ProgramFail( "out of memory");
+		ProgramFailStack();
 	}
 	else {
 		NewFrameParameters = nullptr;
@@ -793,9 +1095,60 @@ PointerType ParseState::VariableDereferencePointer(struct Value *PointerValue,
     if (DerefIsLValue != nullptr)
         *DerefIsLValue = TRUE;
 
+    if (DerefType != nullptr)
+        VariableCheckPointer(PointerValue->getVal<PointerType>(pc), *DerefType);
+    
     return PointerValue->getVal<PointerType>(pc);
 }
 
+/* make sure a pointer the program's about to use points into its own memory */
+void ParseState::VariableCheckPointer(PointerType Addr, struct ValueType *Typ)
+{
+	struct ParseState *Parser = this;
+    int Size;
+    
+    if (Addr == nullptr)
+        return;
+    
+    Size = TypeSize(Typ, Typ->ArraySize, TRUE);
+    if (!pc->Space.SpaceCheck(Addr, Size > 0 ? Size : 1))
+        ProgramFail("pointer is outside the program's memory");
+}
+
+/* make sure a library function can use Size bytes from Addr - they all have to be the program's own */
+void ParseState::VariableCheckRange(const void *Addr, size_t Size)
+{
+	struct ParseState *Parser = this;
+    
+    if (Addr == nullptr || Size == 0)
+        return;
+    
+    if (!pc->Space.SpaceCheck(Addr, Size))
+        ProgramFail("pointer is outside the program's memory");
+}
+
+/* make sure a string ends before the program's memory does, so a library function can read it. 
+ * only the first MaxLen characters are looked at. returns its length, or MaxLen if it's longer */
+size_t ParseState::VariableCheckString(const char *Str, size_t MaxLen)
+{
+	struct ParseState *Parser = this;
+    size_t Extent;
+    const char *End;
+    
+    if (Str == nullptr || MaxLen == 0)
+        return 0;
+    
+    Extent = pc->Space.SpaceExtent(Str);
+    End = (const char *)memchr(Str, '\0', Extent < MaxLen ? Extent : MaxLen);
+    if (End != nullptr)
+        return End - Str;
+    
+    if (Extent < MaxLen)
+        ProgramFail("pointer is outside the program's memory");
+    
+    return MaxLen;
+}
+
 	void Picoc::VariableDefinePlatformVar(const char *Ident, struct ValueType *Typ,
 		UnionAnyValuePointer FromValue, int IsWritable,size_t Size){
 		//size_t Size = TypeSize(Typ, Typ->ArraySize, FALSE);